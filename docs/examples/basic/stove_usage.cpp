@@ -16,13 +16,23 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <Stove.hpp>
 
+#if __cplusplus >= 202002L
+  #include <ranges>
+#endif
+
 using namespace std;
 using namespace kitchen;
 
+#ifdef __cpp_lib_ranges
+static_assert( ranges::random_access_range<Stove> );
+static_assert( ranges::random_access_range<const Stove> );
+#endif
+
 int main( int argc, char **argv ) {
   if( Stove::IsModelSupported( 4 ) ) {
     cout << "model 4 stoves are supported" << endl;
@@ -37,5 +47,17 @@ int main( int argc, char **argv ) {
   my_stove.SetBurnerLevel( 2, 9 );
   cout << "burner 2 level is: " << my_stove.GetBurnerLevel( 2 ) << endl;
 
+  for( int level : my_stove ) {
+    cout << "burner level: " << level << endl;
+  }
+
+  auto hottest = max_element( my_stove.begin(), my_stove.end() );
+  cout << "hottest burner is: " << hottest - my_stove.begin() << endl;
+
+  // copies share the same stove, which is destroyed along with the last one
+  Stove shared_stove = my_stove;
+  shared_stove.SetOvenTemp( 400 );
+  cout << "shared oven temp is: " << my_stove.GetOvenTemp() << endl;
+
   return EXIT_SUCCESS;
 }
@@ -29,3 +29,8 @@ print('current oven temp is: %d' % my_stove.GetOvenTemp())
 
 my_stove.SetBurnerLevel(2, 9);
 print('burner 2 level is: %d' % my_stove.GetBurnerLevel(2))
+
+print('stove has %d burners' % len(my_stove))
+for level in my_stove:
+  print('burner level is: %d' % level)
+print('burner levels are: %s' % my_stove.to_list())
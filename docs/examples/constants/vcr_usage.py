@@ -23,3 +23,6 @@ bedroom = mediacenter.VCR(4)
 
 living_room.SendCommand(living_room.PAUSE_COMMAND)
 bedroom.SendCommand(bedroom.PLAY_COMMAND)
+
+# constants belong to the class, so no instance is needed to use them
+living_room.SendCommand(mediacenter.VCR.REWIND_COMMAND)
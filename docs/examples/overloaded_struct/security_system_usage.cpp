@@ -17,6 +17,7 @@
  */
 
 #include <cstdlib>
+#include <memory>
 #include <SecurityEvent.hpp>
 
 using namespace home_automation;
@@ -26,8 +27,9 @@ main( int argc, char **argv ) {
   for( int i = 0; i < 5; i++ ) {
 
     // calling the static function to get a pointer to the base class
-    // the returned pointer will be to the appropriate derived class
-    SecurityEvent *ev = SecurityEvent::NextEvent();
+    // the returned pointer will be to the appropriate derived class, and
+    // will delete the event when it goes out of scope
+    std::unique_ptr<SecurityEvent> ev = SecurityEvent::NextEvent();
 
     // this will call the Print function in the derived class
     ev->Print();
@@ -20,3 +20,8 @@ import home_automation
 
 for i in range(5):
     home_automation.SecurityEvent.NextEvent().Print()
+
+# the types are created when first used, including by a star import
+from home_automation import *
+
+SecurityEvent.NextEvent().Print()
@@ -18,6 +18,7 @@
 
 #include <cstdlib>
 #include <iostream>
+#include <vector>
 #include <PlayerStats.hpp>
 
 using namespace std;
@@ -37,5 +38,10 @@ int main( int argc, char **argv ) {
   cout << endl << "their player's stats:" << endl;
   their_player.Print();
 
+  vector<unsigned char> saved_stats = my_player.to_bytes();
+  PlayerStats loaded_player = PlayerStats::from_bytes( saved_stats );
+  cout << endl << "my player's stats after saving and loading them:" << endl;
+  loaded_player.Print();
+
   return EXIT_SUCCESS;
 }
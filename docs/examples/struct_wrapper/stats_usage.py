@@ -16,6 +16,7 @@
 # See the License for the specific language governing permissions and
 # limitations under the License.
 
+import pickle
 import soccer
 
 default_player = soccer.PlayerStats()
@@ -29,3 +30,16 @@ my_player.Print()
 their_player = soccer.PlayerStats(0, 4, 4)
 print("\ntheir player's stats:")
 their_player.Print()
+
+saved_stats = my_player.to_bytes()
+loaded_player = soccer.PlayerStats.from_bytes(saved_stats)
+print("\nmy player's stats after saving and loading them:")
+loaded_player.Print()
+
+# with protocol 5 the struct is handed to the callback instead of copied
+buffers = []
+pickled_player = pickle.dumps(their_player, protocol=5,
+                              buffer_callback=buffers.append)
+unpickled_player = pickle.loads(pickled_player, buffers=buffers)
+print("\ntheir player's stats after pickling them:")
+unpickled_player.Print()
@@ -23,3 +23,12 @@ print('listing primes from 0 to 100:')
 for i in range(100):
     if magic_stuff.MagicMath.IsPrime(i):
         print(i)
+
+# the ufuncs are only built if NumPy was available when building the module
+if hasattr(magic_stuff.MagicMath, 'IsPrime_ufunc'):
+    import numpy
+
+    numbers = numpy.arange(100, dtype=numpy.intc)
+    primes = numbers[magic_stuff.MagicMath.IsPrime_ufunc(numbers)]
+    print('the same primes, found using a ufunc:')
+    print(primes)
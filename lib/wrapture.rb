@@ -19,10 +19,12 @@
 # Classes and functions for generating language wrappers
 module Wrapture
   require 'wrapture/action_spec'
+  require 'wrapture/class_family_spec'
   require 'wrapture/comment'
   require 'wrapture/constant_spec'
   require 'wrapture/constants'
   require 'wrapture/class_spec'
+  require 'wrapture/cpp_worker_pool'
   require 'wrapture/cpp_wrapper'
   require 'wrapture/enum_spec'
   require 'wrapture/errors'
@@ -31,12 +33,17 @@ module Wrapture
   require 'wrapture/normalize'
   require 'wrapture/rule_spec'
   require 'wrapture/param_spec'
+  require 'wrapture/python_async_pool'
   require 'wrapture/python_wrapper'
   require 'wrapture/scope'
+  require 'wrapture/sequence_spec'
+  require 'wrapture/sink'
   require 'wrapture/struct_spec'
   require 'wrapture/template_spec'
   require 'wrapture/type_spec'
+  require 'wrapture/typemap_spec'
   require 'wrapture/version'
+  require 'wrapture/watcher'
   require 'wrapture/wrapped_code_spec'
   require 'wrapture/wrapped_function_spec'
 end
@@ -57,6 +57,38 @@ module Wrapture
       @spec = ActionSpec.normalize_spec_hash(spec)
     end
 
+    # A string containing a call to the helper function of this action, which
+    # takes the action out of line. See +define_helper+.
+    def call
+      "#{helper_name}( #{arguments.join(', ')} )"
+    end
+
+    # Gives each line of the definition of a helper function that takes this
+    # action to the provided block.
+    #
+    # The helper is marked as cold and is never inlined, so that the code
+    # constructing and throwing the exception is kept out of the functions
+    # that check for the error. It forwards its arguments to the constructor,
+    # so that it can be used regardless of their types.
+    def define_helper
+      yield 'template<typename... Args>'
+      yield '[[noreturn]] [[gnu::cold]] [[gnu::noinline]]'
+      yield "void #{helper_name}( Args&&... args ) {"
+      yield "  throw #{@spec['constructor']['name']}( " \
+            'std::forward<Args>( args )... );'
+      yield '}'
+    end
+
+    # The name of the helper function of this action, based on the name of the
+    # constructor that it uses.
+    def helper_name
+      parts = @spec['constructor']['name'].split('::').map do |part|
+        part[0].upcase + part[1..]
+      end
+
+      "Throw#{parts.join}"
+    end
+
     # A list of includes needed for the action.
     def includes
       @spec['constructor']['includes'].dup
@@ -64,17 +96,20 @@ module Wrapture
 
     # A string containing the invocation of this action.
     def take
-      call_spec = @spec['constructor']
+      "throw #{@spec['constructor']['name']}( #{arguments.join(', ')} )"
+    end
+
+    private
 
-      params = call_spec['params'].map do |param_spec|
+    # The arguments given to the constructor of this action.
+    def arguments
+      @spec['constructor']['params'].map do |param_spec|
         if param_spec['value'] == RETURN_VALUE_KEYWORD
           'return_val'
         else
           param_spec['value']
         end
       end
-
-      "throw #{call_spec['name']}( #{params.join(', ')} )"
     end
   end
 end
@@ -0,0 +1,133 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+require 'wrapture/named'
+
+module Wrapture
+  # A family of classes instantiated from the same class template, which are
+  # wrapped as a single C++ class template. See TemplateSpec for how a class
+  # template is defined.
+  #
+  # The class template is described by a model ClassSpec, instantiated from
+  # the template with each parameter replaced by the member of the traits
+  # struct that holds it.
+  class ClassFamilySpec
+    include Named
+
+    # The name of the type parameter of the class template.
+    TRAITS_PARAMETER = 'Traits'
+
+    # The classes of the family.
+    attr_reader :members
+
+    # The ClassSpec of the class template itself.
+    attr_reader :model
+
+    # Creates the family of the given classes of a scope, which must all be
+    # instantiated from the given class template with the same parameters.
+    def initialize(template, members, scope)
+      @template = template
+      @members = members
+
+      names = param_names(members.first)
+      members.each do |member|
+        next if param_names(member) == names
+
+        raise InvalidTemplateUsage, "#{member.name} does not give the same " \
+                                    "parameters to #{template.name} as the " \
+                                    'other classes instantiated from it'
+      end
+
+      traits_params = names.map do |param_name|
+        { 'name' => param_name,
+          'value' => "#{TRAITS_PARAMETER}::#{traits_member_name(param_name)}" }
+      end
+      model_spec = template.instantiate(traits_params)
+      check_params(model_spec)
+
+      model_spec['name'] = name
+      unless model_spec.key?('final')
+        model_spec['final'] = members.none? { |member| scope.parent?(member) }
+      end
+
+      # the model is kept out of the scope so that it is not wrapped itself
+      model_scope = Scope.new('name' => scope.name)
+      scope.templates.each { |scope_template| model_scope << scope_template }
+      scope.classes.each { |class_spec| model_scope << class_spec }
+      @model = ClassSpec.new(model_spec, scope: model_scope,
+                                         template_parameter: TRAITS_PARAMETER)
+    end
+
+    # The name of the class template.
+    def name
+      @template.class_template_name
+    end
+
+    # The namespace of the class template.
+    def namespace
+      @model.namespace
+    end
+
+    # A list of pairs of the name of each member of the traits struct of the
+    # given class of the family and the wrapped function that it holds.
+    def traits(member)
+      member.class_template_params.map do |param|
+        [traits_member_name(param['name']), param['value']]
+      end
+    end
+
+    # The name of the traits struct of the given class of the family.
+    def traits_name(member)
+      "#{member.name}Traits"
+    end
+
+    private
+
+    # Raises an InvalidTemplateUsage error if a parameter of the template is
+    # used as anything other than the name of a wrapped function in the given
+    # spec instantiated from it.
+    def check_params(spec, path = [])
+      case spec
+      when Hash
+        spec.each_pair { |key, value| check_params(value, path + [key]) }
+      when Array
+        spec.each_with_index { |value, i| check_params(value, path + [i]) }
+      when String
+        return unless spec.start_with?("#{TRAITS_PARAMETER}::")
+        return if path.last(2) == %w[wrapped-function name]
+
+        raise InvalidTemplateUsage, 'the parameters of class template ' \
+                                    "#{@template.name} may only be used as " \
+                                    'the names of wrapped functions'
+      end
+    end
+
+    # The names of the parameters given to the class template by the given
+    # class of the family.
+    def param_names(member)
+      member.class_template_params.map { |param| param['name'] }
+    end
+
+    # The name of the member of a traits struct holding the given parameter.
+    def traits_member_name(param_name)
+      param_name.tr('-', '_')
+    end
+  end
+end
@@ -26,13 +26,50 @@ module Wrapture
   class ClassSpec
     include Named
 
+    # The keys that a class instantiated from a class template may have for it
+    # to be wrapped as an instance of the class template.
+    CLASS_TEMPLATE_KEYS = ['doc', 'name', TEMPLATE_USE_KEYWORD].freeze
+
+    # The ways that a class may own its equivalent struct.
+    OWNERSHIPS = %w[raw shared shared-nonatomic].freeze
+
+    # Gives the use of a class template by the given class spec hash as a hash
+    # with the +name+ of the template and the +params+ given to it, or nil if
+    # the class is not wrapped as an instance of a class template. Only the
+    # given templates are considered if the use has not already been recorded
+    # in the +class-template+ key.
+    def self.class_template_use(spec, *templates)
+      return spec['class-template'] if spec.key?('class-template')
+      return nil unless (spec.keys - CLASS_TEMPLATE_KEYS).empty?
+
+      template = templates.find do |candidate|
+        candidate.class_template? && candidate.use?(spec)
+      end
+      return nil if template.nil?
+
+      invocation = spec[TEMPLATE_USE_KEYWORD]
+      params = invocation.is_a?(Hash) ? invocation.fetch('params', []) : []
+      { 'name' => template.name, 'params' => params }
+    end
+
     # Gives the effective type of the given class spec hash.
+    #
+    # Classes with a constructor that initializes the struct in place must wrap
+    # the struct itself, so that it is embedded in them.
     def self.effective_type(spec)
       inferred_pointer_wrapper = spec['constructors'].any? do |func|
-        func['wrapped-function']['return']['type'] == EQUIVALENT_POINTER_KEYWORD
+        func['wrapped-function'].dig('return', 'type') ==
+          EQUIVALENT_POINTER_KEYWORD
       end
 
-      if spec.key?('type')
+      if spec['constructors'].any? { |func| in_place_constructor?(func) }
+        if spec.fetch('type', 'struct') != 'struct' || inferred_pointer_wrapper
+          raise InvalidSpecKey, "#{spec['name']} must wrap a struct instead " \
+                                'of a pointer to initialize it in place'
+        end
+
+        'struct'
+      elsif spec.key?('type')
         valid_types = %w[pointer struct]
         unless valid_types.include?(spec['type'])
           type_message = "#{spec['type']} is not a valid class type"
@@ -47,6 +84,16 @@ module Wrapture
       end
     end
 
+    # True if the given constructor spec hash initializes the struct of its
+    # class in place, which is the case if the wrapped function is given a
+    # pointer to it.
+    def self.in_place_constructor?(spec)
+      spec['wrapped-function'].fetch('params', []).any? do |param_spec|
+        param_spec.fetch('value', param_spec['name']) ==
+          EQUIVALENT_POINTER_KEYWORD
+      end
+    end
+
     # Returns a normalized copy of a hash specification of a class. See
     # normalize_spec_hash! for details.
     def self.normalize_spec_hash(spec, *templates)
@@ -87,14 +134,69 @@ module Wrapture
       spec['libraries'] = Wrapture.normalize_array(spec['libraries'])
       spec['type'] = ClassSpec.effective_type(spec)
 
+      Wrapture.normalize_boolean!(spec, 'final') if spec.key?('final')
+      Wrapture.normalize_boolean!(spec, 'static-dispatch')
+      normalize_ownership!(spec)
+      normalize_serializable!(spec)
+
       if spec.key?('parent')
         includes = Wrapture.normalize_array(spec['parent']['includes'])
         spec['parent']['includes'] = includes
       end
 
+      if spec.key?('sequence')
+        spec['sequence'] = SequenceSpec.normalize_spec_hash(spec['sequence'])
+      end
+
       spec
     end
 
+    # Normalizes the ownership of a class spec in place, defaulting it to raw
+    # if it is not given.
+    def self.normalize_ownership!(spec)
+      ownership = spec.fetch('ownership', 'raw')
+      unless OWNERSHIPS.include?(ownership)
+        raise InvalidSpecKey.new("#{ownership} is not a valid ownership",
+                                 valid_keys: OWNERSHIPS)
+      end
+
+      if ownership != 'raw' &&
+         (spec['type'] != 'pointer' || !spec.key?('destructor') ||
+          spec.key?('parent'))
+        raise InvalidSpecKey, "#{spec['name']} must wrap a struct pointer " \
+                              'with a destructor and have no parent to be ' \
+                              'shared'
+      end
+
+      spec['ownership'] = ownership
+    end
+    private_class_method :normalize_ownership!
+
+    # Normalizes the serializable flag of a class spec in place, defaulting it
+    # to false if it is not given.
+    def self.normalize_serializable!(spec)
+      Wrapture.normalize_boolean!(spec, 'serializable')
+
+      if spec['serializable'] &&
+         (spec['type'] != 'struct' || !spec.key?(EQUIVALENT_STRUCT_KEYWORD) ||
+          spec.key?('destructor') || spec.key?('parent'))
+        raise InvalidSpecKey, "#{spec['name']} must hold its struct by " \
+                              'value, without a destructor or parent, to ' \
+                              'be serializable'
+      end
+
+      spec
+    end
+    private_class_method :normalize_serializable!
+
+    # The TemplateSpec of the class template that this class is wrapped as an
+    # instance of, or nil if it is wrapped as a class of its own.
+    attr_reader :class_template
+
+    # The parameters given to the class template of this class, as a list of
+    # hashes with a +name+ and +value+ for each.
+    attr_reader :class_template_params
+
     # The list of constants in this class.
     attr_reader :constants
 
@@ -107,9 +209,17 @@ module Wrapture
     # The scope of this class.
     attr_reader :scope
 
+    # The SequenceSpec of the collection that this class exposes, or nil if it
+    # does not expose one.
+    attr_reader :sequence
+
     # The underlying struct of this class.
     attr_reader :struct
 
+    # The name of the type parameter of this class if it is wrapped as a C++
+    # class template itself, or nil if it is not.
+    attr_reader :template_parameter
+
     # Creates a class spec based on the provided hash spec.
     #
     # The scope can be provided if available. Otherwise, a new Scope is created
@@ -122,13 +232,45 @@ module Wrapture
     #
     # The following keys are optional:
     # constants:: A list of constant specs that are in this class.
-    # constructors:: A list of function specs that can create this class.
+    # constructors:: A list of function specs that can create this class. A
+    # constructor whose wrapped function is given the equivalent-struct-pointer
+    # initializes the struct in place, which is then embedded in the class
+    # instead of allocated by the wrapped library.
     # destructor:: A function spec for the destructor of the class.
     # doc:: a string containing the documentation for this class
+    # final:: set to false to allow a class without children in the scope to
+    # be extended, or to true to mark a class final anyway
     # functions:: A list of function specs that are in this class.
     # includes:: A list of includes that are needed for this class.
     # libraries:: A list of libraries that must be linked to use this class.
-    def initialize(spec, scope: Scope.new)
+    # ownership:: how instances of the class own the struct that they wrap.
+    # The default of raw gives each instance the struct pointer, which is
+    # destroyed along with it. shared instead counts the instances sharing the
+    # struct, destroying it along with the last of them, and shared-nonatomic
+    # does the same with a count that is not safe to share between threads.
+    # The count is allocated when an instance is first copied, so instances
+    # that are never copied cost no more than with raw ownership.
+    # Shared ownership is only available for struct pointer wrappers that have
+    # a destructor and no parent.
+    # serializable:: set to true to give the class functions that copy the
+    # struct it wraps to and from bytes. Only classes wrapping a struct that
+    # is trivially copyable, without a destructor or parent, may be serialized.
+    # sequence:: a map naming the functions that give the count of the items
+    # of a collection in this class and the item at an index of it, which is
+    # wrapped as a sequence. See SequenceSpec for details.
+    # static-dispatch:: set to true to dispatch the virtual functions of this
+    # class to its overloads without a vtable
+    #
+    # If +template_parameter+ is given, the class is wrapped as a C++ class
+    # template taking a type parameter with that name.
+    def initialize(spec, scope: Scope.new, template_parameter: nil)
+      use = ClassSpec.class_template_use(spec, *scope.templates)
+      @class_template = use && scope.templates.find do |template|
+        template.name == use['name']
+      end
+      @class_template_params = use ? use['params'] : []
+      @template_parameter = template_parameter
+
       @spec = ClassSpec.normalize_spec_hash(spec, *scope.templates)
 
       @struct = if @spec.key?(EQUIVALENT_STRUCT_KEYWORD)
@@ -138,7 +280,12 @@ module Wrapture
       @functions = @spec['constructors'].map do |constructor_spec|
         full_spec = constructor_spec.dup
         full_spec['name'] = @spec['name']
-        full_spec['params'] = constructor_spec['wrapped-function']['params']
+        # the struct initialized in place is not a parameter of the class
+        wrapped_params = constructor_spec['wrapped-function']['params'] || []
+        full_spec['params'] = wrapped_params.reject do |param_spec|
+          param_spec.fetch('value', param_spec['name']) ==
+            EQUIVALENT_POINTER_KEYWORD
+        end
 
         FunctionSpec.new(full_spec, self, constructor: true)
       end
@@ -154,6 +301,10 @@ module Wrapture
         @functions << FunctionSpec.new(function_spec, self)
       end
 
+      @sequence = if @spec.key?('sequence')
+                    SequenceSpec.new(@spec['sequence'], self)
+                  end
+
       @constants = @spec['constants'].map do |constant_spec|
         ConstantSpec.new(constant_spec)
       end
@@ -197,6 +348,8 @@ module Wrapture
     def definition_includes
       includes = @spec['includes'].dup
 
+      includes.concat(@struct.includes) if @struct
+
       @functions.each do |func|
         includes.concat(func.definition_includes)
       end
@@ -234,12 +387,38 @@ module Wrapture
         parent.pointer_wrapper? != pointer_wrapper?
     end
 
+    # A list of includes needed for the declaration of the class when the
+    # structs of the wrapped library are forward declared instead of included.
+    # This leaves out the includes of the class itself and of its struct.
+    def forward_declaration_includes
+      includes = []
+
+      @functions.each do |func|
+        includes.concat(func.declaration_includes)
+      end
+
+      includes.concat(@spec['parent']['includes']) if child?
+
+      includes.uniq
+    end
+
     # True if this class can be used as a factory for children classes that it
     # overloads.
     def factory?
       @scope.overloads?(self)
     end
 
+    # True if this class is declared final. Unless given in the spec, this is
+    # true for classes that no other class in the scope names as its parent.
+    def final?
+      @spec.fetch('final') { !@scope.parent?(self) }
+    end
+
+    # True if a constructor of this class initializes its struct in place.
+    def in_place?
+      constructors.any?(&:in_place?)
+    end
+
     # An array of libraries needed for everything in this class.
     def libraries
       @functions.flat_map(&:libraries).concat(@spec['libraries'])
@@ -264,6 +443,12 @@ module Wrapture
       @spec['namespace']
     end
 
+    # How instances of this class own their equivalent struct, one of
+    # OWNERSHIPS.
+    def ownership
+      @spec['ownership']
+    end
+
     # True if this class overloads the given one. A class is considered an
     # overload of another if it has the same equivalent struct name and
     # the equivalent struct has a set of rules. The overloaded class
@@ -304,6 +489,25 @@ module Wrapture
       @spec['type'] == 'pointer'
     end
 
+    # True if the class can be copied to and from bytes.
+    def serializable?
+      @spec['serializable']
+    end
+
+    # True if instances of this class share their equivalent struct, counting
+    # the references to it.
+    def shared?
+      ownership != 'raw'
+    end
+
+    # True if the virtual functions of this class are dispatched to its
+    # overloads by checking the rules of their structs rather than through a
+    # vtable. Overloaded returns of such a class create the class itself
+    # instead of its children.
+    def static_dispatch?
+      @spec['static-dispatch']
+    end
+
     # The name of the equivalent struct of this class.
     def struct_name
       @struct.name
@@ -38,4 +38,38 @@ module Wrapture
   KEYWORDS = [EQUIVALENT_STRUCT_KEYWORD, EQUIVALENT_POINTER_KEYWORD,
               SELF_REFERENCE_KEYWORD, RETURN_VALUE_KEYWORD,
               TEMPLATE_USE_KEYWORD].freeze
+
+  # The name of the macro used in generated code to mark a condition as
+  # unlikely to be true, such as the condition of an error check.
+  UNLIKELY_MACRO = 'WRAPTURE_UNLIKELY'
+
+  # The name of the macro used in generated code to give a class default
+  # visibility, so that it is exported from a library built with hidden
+  # visibility.
+  EXPORT_MACRO = 'WRAPTURE_EXPORT'
+
+  # The name of the macro used in generated code to warn when the result of a
+  # function without side effects is discarded.
+  NODISCARD_MACRO = 'WRAPTURE_NODISCARD'
+
+  # The name of the macro used in generated code to mark a function as pure.
+  PURE_MACRO = 'WRAPTURE_PURE'
+
+  # The name of the macro used in generated code to mark a function as const,
+  # in the sense of the const function attribute of GCC.
+  CONST_MACRO = 'WRAPTURE_CONST'
+
+  # The name of the macro defined when a generated Python module is built
+  # with NumPy available, which enables the ufuncs of the module.
+  NUMPY_MACRO = 'WRAPTURE_NUMPY'
+
+  # The number of bytes in the header written before the struct of a
+  # serializable class, which holds a byte order mark, the size of the struct,
+  # and the fingerprint of its layout.
+  LAYOUT_HEADER_SIZE = 16
+
+  # The mark written at the start of the header of a serialized struct in the
+  # byte order of the machine writing it, so that a reader can tell if its
+  # own byte order is different.
+  BYTE_ORDER_MARK = '0x01020304'
 end
@@ -0,0 +1,235 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # Generates the header holding the worker pool that asynchronous functions
+  # of C++ wrappers run their blocking calls on.
+  #
+  # The header defines a +WorkerPool+ class with a lazily created default
+  # instance, and when the compiler supports coroutines an +Awaitable+ class
+  # template that runs a call on a pool and resumes the awaiting coroutine with
+  # its result or exception.
+  class CppWorkerPool
+    # The name of the file holding the worker pool.
+    FILENAME = 'WorkerPool.hpp'
+
+    # Creates a worker pool generator for the given namespace.
+    def initialize(namespace)
+      @namespace = namespace
+    end
+
+    # Gives each line of the worker pool header to the provided block.
+    def define(&block)
+      guard = "#{@namespace.upcase}_WORKER_POOL_HPP"
+
+      <<~POOLTEXT.each_line(chomp: true, &block)
+        #ifndef #{guard}
+        #define #{guard}
+
+        #include <condition_variable>
+        #include <cstddef>
+        #include <deque>
+        #include <exception>
+        #include <functional>
+        #include <future>
+        #include <memory>
+        #include <mutex>
+        #include <thread>
+        #include <utility>
+        #include <vector>
+
+        #ifdef __cpp_impl_coroutine
+          #include <coroutine>
+          #include <optional>
+          #include <type_traits>
+        #endif
+
+        namespace #{@namespace} {
+
+          /**
+           * A pool of threads that runs the blocking calls made by asynchronous
+           * functions.
+           */
+          class WorkerPool {
+          public:
+            /**
+             * The pool used by asynchronous functions when none is given. It is
+             * created on first use with the number of threads last given to
+             * SetDefaultThreadCount, or one per hardware thread if none was.
+             */
+            static WorkerPool& Default( void ) {
+              static WorkerPool pool( DefaultThreadCount() );
+              return pool;
+            }
+
+            /**
+             * Sets the number of threads in the default pool. This has no
+             * effect once the default pool has been used.
+             */
+            static void SetDefaultThreadCount( std::size_t thread_count ) {
+              DefaultThreadCount() = thread_count;
+            }
+
+            explicit WorkerPool( std::size_t thread_count ) {
+              if( thread_count == 0 ) {
+                thread_count = 1;
+              }
+
+              for( std::size_t i = 0; i < thread_count; i++ ) {
+                this->workers.emplace_back( [this]() { this->Work(); } );
+              }
+            }
+
+            WorkerPool( const WorkerPool& ) = delete;
+            WorkerPool& operator=( const WorkerPool& ) = delete;
+
+            ~WorkerPool( void ) {
+              {
+                std::lock_guard<std::mutex> lock( this->mutex );
+                this->stopping = true;
+              }
+
+              this->ready.notify_all();
+              for( std::thread& worker : this->workers ) {
+                worker.join();
+              }
+            }
+
+            /**
+             * Queues a task to be run by one of the threads of the pool.
+             */
+            void Submit( std::function<void()> task ) {
+              {
+                std::lock_guard<std::mutex> lock( this->mutex );
+                this->tasks.push_back( std::move( task ) );
+              }
+
+              this->ready.notify_one();
+            }
+
+            /**
+             * Runs a call on the pool, giving a future for its result. An
+             * exception thrown by the call is rethrown by the future.
+             */
+            template<typename Result, typename Call>
+            std::future<Result> Run( Call call ) {
+              using Task = std::packaged_task<Result()>;
+              auto task = std::make_shared<Task>( std::move( call ) );
+              std::future<Result> result = task->get_future();
+              this->Submit( [task]() { ( *task )(); } );
+              return result;
+            }
+
+          private:
+            static std::size_t& DefaultThreadCount( void ) {
+              static std::size_t thread_count =
+                std::thread::hardware_concurrency();
+              return thread_count;
+            }
+
+            void Work( void ) {
+              for( ;; ) {
+                std::function<void()> task;
+
+                {
+                  std::unique_lock<std::mutex> lock( this->mutex );
+                  this->ready.wait( lock, [this]() {
+                    return this->stopping || !this->tasks.empty();
+                  } );
+
+                  if( this->tasks.empty() ) {
+                    return;
+                  }
+
+                  task = std::move( this->tasks.front() );
+                  this->tasks.pop_front();
+                }
+
+                task();
+              }
+            }
+
+            std::mutex mutex;
+            std::condition_variable ready;
+            std::deque<std::function<void()>> tasks;
+            std::vector<std::thread> workers;
+            bool stopping = false;
+          };
+
+        #ifdef __cpp_impl_coroutine
+          /**
+           * Runs a call on a worker pool when awaited. The awaiting coroutine
+           * is resumed on the worker thread once the call completes, receiving
+           * its result or having its exception rethrown.
+           */
+          template<typename Result>
+          class Awaitable {
+          public:
+            Awaitable( std::function<Result()> call, WorkerPool& pool )
+              : call( std::move( call ) ), pool( pool ) {}
+
+            bool await_ready( void ) const noexcept {
+              return false;
+            }
+
+            void await_suspend( std::coroutine_handle<> handle ) {
+              this->pool.Submit( [this, handle]() {
+                try {
+                  if constexpr( std::is_void<Result>::value ) {
+                    this->call();
+                  } else {
+                    this->result.emplace( this->call() );
+                  }
+                } catch( ... ) {
+                  this->error = std::current_exception();
+                }
+
+                handle.resume();
+              } );
+            }
+
+            Result await_resume( void ) {
+              if( this->error ) {
+                std::rethrow_exception( this->error );
+              }
+
+              if constexpr( !std::is_void<Result>::value ) {
+                return std::move( *this->result );
+              }
+            }
+
+          private:
+            using Storage = typename std::conditional<
+              std::is_void<Result>::value, bool, Result>::type;
+
+            std::function<Result()> call;
+            WorkerPool& pool;
+            std::optional<Storage> result;
+            std::exception_ptr error;
+          };
+        #endif
+
+        }
+
+        #endif /* #{guard} */
+      POOLTEXT
+    end
+  end
+end
@@ -21,9 +21,19 @@
 module Wrapture
   # A wrapper that generates C++ wrappers for given specs.
   class CppWrapper
-    # Gives the filename used for the declaration of a given class spec.
+    # The words that make up the names of types built into C and C++, which
+    # never need an include or declaration to be used.
+    BUILTIN_TYPE_WORDS = %w[bool char const double float int long short signed
+                            unsigned void volatile].freeze
+
+    # Gives the filename used for the declaration of a given class spec. This
+    # is the header of the class template for a class wrapped as one.
     def self.declaration_filename(class_spec)
-      "#{class_spec.name}.hpp"
+      if class_spec.is_a?(ClassSpec) && class_spec.class_template
+        "#{class_spec.class_template.class_template_name}.hpp"
+      else
+        "#{class_spec.name}.hpp"
+      end
     end
 
     # Gives each line of the declaration of a spec to the provided block
@@ -42,10 +52,18 @@ module Wrapture
       wrapper.define(&block)
     end
 
+    # Generates C++ source files into the given sink, returning a list of the
+    # files generated. This is equivalent to instantiating a wrapper with the
+    # given spec, and then calling generate_source_files on that.
+    def self.generate_spec_source_files(spec, sink, **kwargs)
+      wrapper = new(spec)
+      wrapper.generate_source_files(sink, **kwargs)
+    end
+
     # An array of source filenames that will be generated by this wrapper.
-    def self.source_files(spec)
+    def self.source_files(spec, **kwargs)
       wrapper = new(spec)
-      wrapper.source_files
+      wrapper.source_files(**kwargs)
     end
 
     # Generates C++ source files, returning a list of the files generated. This
@@ -56,9 +74,15 @@ module Wrapture
       wrapper.write_source_files(**kwargs)
     end
 
-    # Creates a C++ wrapper for a given spec.
+    # Creates a C++ wrapper for a given spec. A ClassFamilySpec is wrapped as
+    # its model class, with the traits and aliases of its classes added.
     def initialize(spec)
-      @spec = spec
+      if spec.is_a?(ClassFamilySpec)
+        @family = spec
+        @spec = spec.model
+      else
+        @spec = spec
+      end
     end
 
     # Gives a list of ancestor classes of class spec, including a colon prefix,
@@ -72,6 +96,19 @@ module Wrapture
       end
     end
 
+    # True if any function generated by this wrapper has asynchronous variants,
+    # which need the worker pool support file.
+    def async?
+      case @spec
+      when Scope
+        @spec.classes.any? { |spec| spec.method_specs.any?(&:async?) }
+      when ClassSpec
+        @spec.method_specs.any?(&:async?)
+      else
+        false
+      end
+    end
+
     # The name of the file that the declaration of this spec will be written to.
     # This may be the same as the definition filename for specs that are not
     # forward declared.
@@ -118,17 +155,174 @@ module Wrapture
       end
     end
 
+    # Gives each line of the declaration of the spec as it is exported from the
+    # interface unit of the module of its scope to the provided block. Unlike
+    # +declare+, this has no header guard, includes, or enclosing namespace.
+    def export(&block)
+      case @spec
+      when ClassSpec
+        declare_class_body(&block)
+      when EnumSpec
+        define_enum_body(2, &block)
+      end
+    end
+
     # True if this instance's spec has separate definition and declaration
     # files.
     def forward_declared?
       !@spec.is_a?(EnumSpec)
     end
 
+    # Generates a CMakeLists.txt file that can be used to build the files
+    # generated by +write_source_files+ into the given sink, along with the
+    # package configuration file that it installs, returning a list of the
+    # files generated. +sink+ may be a Sink or any target accepted by one. If
+    # +modules+ is true, the file builds the files generated as a C++20 module
+    # instead, declaring the interface unit in a CXX_MODULES file set.
+    def generate_cmake_files(sink, modules: false)
+      unless @spec.is_a?(Scope)
+        raise WrapError, 'only a scope can be used for cmake generation'
+      end
+
+      sink = Sink.for(sink)
+      [sink.write_file('CMakeLists.txt') do |out|
+        define_cmake(modules: modules, &out)
+      end,
+       sink.write_file(cmake_config_filename) do |out|
+         define_cmake_config(&out)
+       end]
+    end
+
+    # Generates the C++ declaration into the given sink, returning the name of
+    # the file generated.
+    def generate_declaration_file(sink)
+      Sink.for(sink).write_file(declaration_filename) { |out| declare(&out) }
+    end
+
+    # Generates the C++ definition into the given sink, returning the name of
+    # the file generated.
+    def generate_definition_file(sink)
+      Sink.for(sink).write_file(definition_filename) { |out| define(&out) }
+    end
+
+    # Generates the C++20 module interface unit of a scope into the given
+    # sink, returning the name of the file generated.
+    def generate_module_interface_file(sink)
+      unless @spec.is_a?(Scope)
+        raise WrapError, 'only a scope can be generated as a module interface'
+      end
+
+      Sink.for(sink).write_file(module_interface_filename) do |out|
+        define_module_interface(&out)
+      end
+    end
+
+    # Generates the definition of a class as an implementation unit of the
+    # module of its scope into the given sink, returning the name of the file
+    # generated.
+    def generate_module_unit_file(sink)
+      Sink.for(sink).write_file(definition_filename) do |out|
+        define_class_module_unit(&out)
+      end
+    end
+
+    # Generates C++ source files into the given sink, returning a list of the
+    # files generated. +sink+ may be a Sink or any target accepted by one, for
+    # example a Hash which will map each filename to its contents.
+    #
+    # Support files needed by the generated code, such as the worker pool used
+    # by asynchronous functions, are also generated unless +support_files+ is
+    # false. A scope generates these once for all of its classes.
+    #
+    # If +modules+ is true, a scope is generated as a C++20 module made up of
+    # a single interface unit exporting all of its classes and enums, and an
+    # implementation unit for each class, instead of a header for each.
+    def generate_source_files(sink, support_files: true, modules: false)
+      sink = Sink.for(sink)
+
+      files = if @spec.is_a?(Scope)
+                scope_files = []
+                scope_files << generate_module_interface_file(sink) if modules
+                scope_specs(modules).each do |spec|
+                  spec_files = self.class.generate_spec_source_files(
+                    spec, sink, support_files: false, modules: modules
+                  )
+                  scope_files.concat(spec_files)
+                end
+                scope_files
+              elsif modules
+                @spec.is_a?(ClassSpec) ? [generate_module_unit_file(sink)] : []
+              elsif forward_declared?
+                [generate_declaration_file(sink),
+                 generate_definition_file(sink)]
+              else
+                [generate_definition_file(sink)]
+              end
+
+      files.concat(generate_support_files(sink)) if support_files
+
+      files
+    end
+
+    # Generates the support files needed by the code generated by this wrapper
+    # into the given sink, returning a list of the files generated. Nothing is
+    # generated if no support files are needed.
+    def generate_support_files(sink)
+      return [] unless async?
+
+      worker_pool = CppWorkerPool.new(support_namespace)
+      [Sink.for(sink).write_file(CppWorkerPool::FILENAME) do |out|
+        worker_pool.define(&out)
+      end]
+    end
+
     # Gives the symbol to use for header guard checks.
     def header_guard
       "#{@spec.name.upcase}_HPP"
     end
 
+    # The expression giving the result of the function of this wrapper with
+    # a single call of its wrapped function, for use in definitions inlined
+    # in the declaration of its class. This is nil if the function needs more
+    # than that call, for example to check the result for an error, or if it
+    # may be overridden.
+    def inline_call_expression
+      return nil unless @spec.wrapped.is_a?(WrappedFunctionSpec) &&
+                        @spec.returns_call_directly? && !@spec.variadic? &&
+                        !@spec.virtual? && !@spec.return_overloaded? &&
+                        @spec.return_ownership == 'raw'
+
+      return_cast(@spec.wrapped.call_from(self))
+    end
+
+    # The name of the file that the module interface unit of a scope is
+    # written to.
+    def module_interface_filename
+      "#{@spec.name}.cppm"
+    end
+
+    # A list of the includes that the declaration of the spec needs in the
+    # global module fragment of the module interface unit of its scope.
+    #
+    # Unlike those of a generated header, these always include the headers of
+    # the wrapped library, as a struct forward declared within the module
+    # would be attached to the module instead of to the library.
+    def module_interface_includes
+      case @spec
+      when Scope
+        includes = @spec.flat_map do |spec|
+          self.class.new(spec).module_interface_includes
+        end
+        global_fragment_includes(includes)
+      when ClassSpec
+        includes = declaration_includes(forward_declare: false)
+        includes << CppWorkerPool::FILENAME if async?
+        includes
+      else
+        @spec.definition_includes
+      end
+    end
+
     # Gives an expression for using a given parameter.
     # Equivalent structs and pointers are resolved, as well as casts between
     # types if they are known within the scope of this function.
@@ -154,80 +348,35 @@ module Wrapture
     end
 
     # An array of source filenames that will be generated by this wrapper.
-    def source_files
-      if @spec.is_a?(Scope)
-        @spec.flat_map do |spec|
-          self.class.source_files(spec)
-        end
-      elsif forward_declared?
-        [declaration_filename, definition_filename]
-      else
-        [definition_filename]
-      end
+    # Support files are included unless +support_files+ is false, and the
+    # files of a module are given instead of headers if +modules+ is true.
+    def source_files(support_files: true, modules: false)
+      files = if @spec.is_a?(Scope)
+                scope_files = []
+                scope_files << module_interface_filename if modules
+                scope_specs(modules).each do |spec|
+                  scope_files.concat(self.class.source_files(
+                    spec, support_files: false, modules: modules
+                  ))
+                end
+                scope_files
+              elsif modules
+                @spec.is_a?(ClassSpec) ? [definition_filename] : []
+              elsif forward_declared?
+                [declaration_filename, definition_filename]
+              else
+                [definition_filename]
+              end
+
+      files << CppWorkerPool::FILENAME if support_files && async?
+
+      files
     end
 
     # Generates a CMakeLists.txt file that can be used to build the files
-    # generated by +write_source_files+.
-    def write_cmake_files(dir: Dir.pwd)
-      unless @spec.is_a?(Scope)
-        raise WrapError, 'only a scope can be used for cmake generation'
-      end
-
-      filename = 'CMakeLists.txt'
-
-      headers = []
-      sources = []
-
-      source_files.each do |source|
-        headers.append(source) if source.end_with?('.hpp')
-        sources.append(source) if source.end_with?('.cpp')
-      end
-
-      File.open(File.join(dir, filename), 'w') do |file|
-        file.puts('cmake_minimum_required(VERSION 3.0.2)')
-        file.puts("project(#{@spec.name})")
-        file.puts
-
-        header_list = "#{@spec.name.upcase}_HEADERS"
-        file.puts("set(#{header_list}")
-        headers.each do |source|
-          file.puts("  #{source}")
-        end
-        file.puts(')')
-        file.puts
-
-        unless sources.empty?
-          source_list = "#{@spec.name.upcase}_SOURCES"
-          file.puts("set(#{source_list}")
-          sources.each do |source|
-            file.puts("  #{source}")
-          end
-          file.puts(')')
-          file.puts
-
-          lib_targets = []
-          @spec.libraries.each do |lib|
-            target_name = "#{@spec.name}_#{lib}"
-            file.puts("find_library(LIB#{lib.upcase}_FOUND #{lib})")
-            file.puts("add_library(#{target_name} SHARED IMPORTED)")
-            file.puts("set_target_properties(#{target_name} PROPERTIES")
-            file.puts("  IMPORTED_LOCATION ${LIB#{lib.upcase}_FOUND}")
-            file.puts(')')
-            file.puts
-
-            lib_targets.append(target_name)
-          end
-
-          lib_deps = lib_targets.join(' ')
-          file.puts("add_library(#{@spec.name} ${#{source_list}})")
-          file.puts("target_link_libraries(#{@spec.name} PRIVATE #{lib_deps})")
-          file.puts
-        end
-
-        file.puts('# todo add install command with headers')
-      end
-
-      [filename]
+    # generated by +write_source_files+, as a module if +modules+ is true.
+    def write_cmake_files(dir: Dir.pwd, modules: false)
+      generate_cmake_files(dir, modules: modules)
     end
 
     # Generates the C++ declaration file, returning the name of the file
@@ -235,11 +384,7 @@ module Wrapture
     # +dir+ specifies the directory that the file should be written into. The
     # default is the current working directory.
     def write_declaration_file(dir: Dir.pwd)
-      File.open(File.join(dir, declaration_filename), 'w') do |file|
-        declare { |line| file.puts(line) }
-      end
-
-      declaration_filename
+      generate_declaration_file(dir)
     end
 
     # Generates the C++ definition file, returning the name of the file
@@ -247,34 +392,100 @@ module Wrapture
     # +dir+ specifies the directory that the file should be written into. The
     # default is the current working directory.
     def write_definition_file(dir: Dir.pwd)
-      File.open(File.join(dir, definition_filename), 'w') do |file|
-        self.class.define_spec(@spec) { |line| file.puts(line) }
-      end
-
-      definition_filename
+      generate_definition_file(dir)
     end
 
     # Generates C++ source files, returning a list of the files generated.
     # +dir+ specifies the directory that the files should be written into. The
-    # default is the current working directory.
-    def write_source_files(dir: Dir.pwd)
-      if @spec.is_a?(Scope)
-        @spec.flat_map do |spec|
-          self.class.write_spec_source_files(spec, dir: dir)
-        end
-      elsif forward_declared?
-        [write_declaration_file(dir: dir),
-         write_definition_file(dir: dir)]
+    # default is the current working directory. If +modules+ is true, a scope
+    # is written as a C++20 module, see +generate_source_files+.
+    def write_source_files(dir: Dir.pwd, modules: false)
+      generate_source_files(dir, modules: modules)
+    end
+
+    private
+
+    # The lambda expression calling the given function with the parameters it
+    # was given, for use by its asynchronous variants.
+    def async_call_lambda(func_spec)
+      param_names = func_spec.params.map(&:name)
+      args = param_names.empty? ? '' : " #{param_names.join(', ')} "
+      specifier = ''
+
+      if func_spec.static?
+        captures = param_names
+        call = "#{func_spec.name}(#{args})"
+      elsif async_copies_instance?(func_spec)
+        captures = ['self = *this'].concat(param_names)
+        call = "self.#{func_spec.name}(#{args})"
+        specifier = ' mutable'
       else
-        [write_definition_file(dir: dir)]
+        captures = ['this'].concat(param_names)
+        call = "this->#{func_spec.name}(#{args})"
       end
+
+      "[#{captures.join(', ')}]()#{specifier} { return #{call}; }"
     end
 
-    private
+    # True if the asynchronous variants of the given function capture a copy
+    # of the instance rather than a pointer to it. This is only done for final
+    # classes with atomic shared ownership, where the copy shares the struct
+    # of the instance without slicing it or racing on its reference count.
+    def async_copies_instance?(func_spec)
+      owner = func_spec.owner
+
+      !func_spec.static? && owner.ownership == 'shared' && owner.final?
+    end
+
+    # A list of FunctionSpecs in this class that have asynchronous variants.
+    def async_functions
+      @spec.method_specs.select(&:async?)
+    end
+
+    # The sentence documenting how the asynchronous variants of the given
+    # function hold on to the instance, or nil for a static function.
+    def async_instance_doc(func_spec)
+      return nil if func_spec.static?
 
-    # True if this class should have a pointer constructor generated.
+      if async_copies_instance?(func_spec)
+        'The instance is captured as a copy sharing its struct, so it may ' \
+          'be destroyed before the call completes.'
+      else
+        'The instance is captured by pointer, so it must outlive the ' \
+          'returned future or awaitable.'
+      end
+    end
+
+    # The parameter list for an asynchronous variant of a function, which adds
+    # the pool to run the call on to those of the function. The pool defaults
+    # to the default pool if +declaration+ is true.
+    def async_param_list(func_spec, declaration: true)
+      pool_param = "#{worker_pool_class}& pool"
+      pool_param += " = #{worker_pool_class}::Default()" if declaration
+
+      params = function_definition_param_list(func_spec)
+      params == 'void' ? pool_param : "#{params}, #{pool_param}"
+    end
+
+    # The type of the result of an asynchronous variant of a function.
+    def async_result_type(func_spec)
+      return_type = func_spec.return_type
+      if return_type.self_reference? || return_type.function? ||
+         func_spec.variadic?
+        raise WrapError, "#{func_spec.name} cannot be made asynchronous, as " \
+                         'it returns a self-reference or function pointer ' \
+                         'or is variadic'
+      end
+
+      type_variable(func_spec.resolved_return)
+    end
+
+    # True if this class should have a pointer constructor generated. Classes
+    # that clean up a struct they initialized in place do not get one, as they
+    # would clean up a copy of a struct that they did not initialize.
     def autogen_pointer_constructor?
       return false unless @spec.struct
+      return false if @spec.in_place? && @spec.destructor
 
       types = [EQUIVALENT_POINTER_KEYWORD, @spec.struct.pointer_declaration('')]
 
@@ -337,7 +548,45 @@ module Wrapture
       functions
     end
 
-    # A list of includes common to both a class definition and declaration.
+    # The head of the declaration of the class, made up of its name, the final
+    # specifier if it is final, and its ancestors.
+    def class_head
+      head = [EXPORT_MACRO, @spec.name]
+      head << 'final' if @spec.final?
+      head << ancestor_suffix if @spec.child?
+      head.join(' ')
+    end
+
+    # The name of the given class as used outside of its declaration, which
+    # includes the type parameter of a class template.
+    def class_name(class_spec)
+      if class_spec.template_parameter
+        "#{class_spec.name}<#{class_spec.template_parameter}>"
+      else
+        class_spec.name
+      end
+    end
+
+    # The name of the package configuration file of this scope.
+    def cmake_config_filename
+      "#{@spec.name}Config.cmake"
+    end
+
+    # The include directories given in the build options of this scope, each
+    # preceded by a space for use in a CMake command.
+    def cmake_include_dirs
+      @spec.build['include-dirs'].map { |dir| " #{dir}" }.join
+    end
+
+    # True if the given FunctionSpec is a const member function of its class,
+    # which is the case for those that have no side effects.
+    def const_member?(func_spec)
+      func_spec.owner.is_a?(ClassSpec) && func_spec.side_effect_free? &&
+        !func_spec.static?
+    end
+
+    # A list of includes needed by either a class definition or declaration.
+    # The declaration only needs some of these, see +declaration_includes+.
     def common_includes(class_spec)
       includes = []
 
@@ -360,9 +609,98 @@ module Wrapture
       includes
     end
 
-    # A list of includes needed for the definition of the class.
-    def declaration_includes
-      @spec.declaration_includes.concat(common_includes(@spec))
+    # A list of includes needed for the declaration of the class.
+    #
+    # The headers of the wrapped library are left out unless the declaration
+    # needs the full definition of one of their types, for example to hold
+    # the equivalent struct by value. Structs and classes that are only used
+    # through a pointer or reference are forward declared instead, see
+    # +forward_declared_structs+ and +forward_declared_classes+, and the
+    # includes given for them are left to the definition. The headers are
+    # always included if +forward_declare+ is false.
+    def declaration_includes(forward_declare: true)
+      requirements = declaration_requirements
+      library = !forward_declare || library_declarations_needed?(requirements)
+
+      includes = if library
+                   @spec.declaration_includes
+                 else
+                   @spec.forward_declaration_includes
+                 end
+
+      if forward_declare
+        # structs are declared by the library headers when they are included
+        kinds = library ? %i[class] : %i[class struct]
+        includes -= forward_declared_type_includes(kinds)
+      end
+
+      if @spec.child?
+        parent_spec = @spec.parent_spec
+        includes << self.class.declaration_filename(parent_spec) if parent_spec
+      end
+
+      requirements.each do |kind, value|
+        includes << value if kind == :include
+      end
+
+      includes << 'memory' if unique_ptr_returned?
+      includes << 'atomic' if @spec.ownership == 'shared'
+      includes.concat(%w[cstddef cstdint vector]) if @spec.serializable?
+
+      if @spec.sequence
+        includes.concat(%w[cstddef iterator])
+        # the sequence calls the wrapped functions from the declaration
+        includes.concat(@spec.definition_includes) if sequence_inlined?
+      end
+
+      includes.uniq
+    end
+
+    # A list of pairs describing what the declaration of the class needs for
+    # each of the types that it uses, as given by +type_requirements+.
+    def declaration_requirements
+      types = class_functions.flat_map do |func_spec|
+        params = func_spec.params.map { |param| param.type.resolve(func_spec) }
+        params << func_spec.resolved_return
+      end
+      types.concat(@spec.constants.map(&:type))
+
+      types.flat_map { |type| type_requirements(type) }.uniq
+    end
+
+    # Gives each line of the declarations of the asynchronous variants of the
+    # given FunctionSpec to the provided block.
+    def declare_async_function(func_spec)
+      result = async_result_type(func_spec)
+      modifier_prefix = func_spec.static? ? 'static ' : ''
+      params = async_param_list(func_spec)
+
+      future_text = "Runs #{func_spec.name} on a worker pool, giving a " \
+                    'future for its result. Parameters are captured by ' \
+                    'value, so any data that they point to must remain ' \
+                    'valid until the call completes.'
+      instance_text = async_instance_doc(func_spec)
+      future_text += " #{instance_text}" if instance_text
+      future_doc = Comment.new(future_text)
+      future_doc.format_as_doxygen(max_line_length: 76) { |line| yield line }
+      yield "#{modifier_prefix}std::future<#{result}> " \
+            "#{func_spec.name}Future( #{params} );"
+
+      yield '#ifdef __cpp_impl_coroutine'
+      captured = if func_spec.static?
+                   'Parameters are'
+                 else
+                   'Parameters and the instance are'
+                 end
+      async_doc = Comment.new("Runs #{func_spec.name} on a worker pool when " \
+                              'awaited, resuming the awaiting coroutine with ' \
+                              "its result. #{captured} captured in the same " \
+                              "way as #{func_spec.name}Future.")
+      async_doc.format_as_doxygen(max_line_length: 76) { |line| yield line }
+      awaitable = "#{worker_pool_namespace}::Awaitable<#{result}>"
+      yield "#{modifier_prefix}#{awaitable} " \
+            "#{func_spec.name}Async( #{params} );"
+      yield '#endif'
     end
 
     # Gives each line of the declaration of a ClassSpec to the provided block.
@@ -371,16 +709,58 @@ module Wrapture
       yield "#define #{header_guard}"
       yield ''
 
-      unless @spec.declaration_includes.empty?
-        declaration_includes.each { |inc| yield "#include <#{inc}>" }
+      # the traits of a class template need the wrapped functions declared
+      includes = declaration_includes(forward_declare: @family.nil?)
+      includes.concat(@spec.definition_includes) if @family
+      includes.uniq!
+      includes << CppWorkerPool::FILENAME if async?
+      unless includes.empty?
+        includes.each { |inc| yield "#include <#{inc}>" }
+        yield ''
+      end
+
+      define_export_macro { |line| yield line }
+      yield ''
+
+      if function_attributes?
+        define_attribute_macros { |line| yield line }
+        yield ''
+      end
+
+      structs = forward_declared_structs
+      unless structs.empty?
+        structs.each { |struct_name| yield "struct #{struct_name};" }
         yield ''
       end
 
       yield "namespace #{@spec.namespace} {"
       yield ''
 
+      classes = forward_declared_classes
+      unless classes.empty?
+        classes.each { |class_name| yield "  class #{class_name};" }
+        yield ''
+      end
+
+      declare_class_body { |line| yield line }
+
+      @family&.members&.each do |member|
+        yield ''
+        declare_family_member(member) { |line| yield "  #{line}" }
+      end
+
+      yield ''
+      yield '}' # end of namespace
+      yield ''
+      yield "#endif /* #{header_guard} */"
+    end
+
+    # Gives each line of the declaration of the class itself to the provided
+    # block, indented for use within its namespace.
+    def declare_class_body
       @spec.documentation { |line| yield "  #{line}" }
-      yield "  class #{@spec.name} #{ancestor_suffix} {"
+      yield "  #{template_head(@spec)}" if @spec.template_parameter
+      yield "  class #{class_head} {"
       yield '  public:'
 
       unless @spec.constants.empty?
@@ -394,16 +774,52 @@ module Wrapture
         self.class.declare_spec(function) { |line| yield "    #{line}" }
       end
 
+      async_functions.each do |function|
+        declare_async_function(function) { |line| yield "    #{line}" }
+      end
+
+      if @spec.shared?
+        declare_shared_ownership { |line| yield "    #{line}" }
+      end
+
+      if @spec.in_place? && @spec.destructor
+        declare_in_place_storage { |line| yield "    #{line}" }
+      end
+
+      if @spec.serializable?
+        yield ''
+        declare_serialization do |line|
+          yield line.empty? ? line : "    #{line}"
+        end
+      end
+
+      if @spec.sequence
+        yield ''
+        declare_sequence { |line| yield line.empty? ? line : "    #{line}" }
+      end
+
       if @spec.equivalent_member?
         yield ''
         yield "    #{equivalent_member_declaration}"
       end
 
+      if @spec.shared?
+        count_type = reference_count_type
+        yield ''
+        yield '  private:'
+        # the count is only allocated once an instance is first copied, so
+        # that instances that are never copied don't need a second allocation
+        if @spec.ownership == 'shared'
+          yield "    mutable std::atomic<#{count_type} *> " \
+                'references{ nullptr };'
+        else
+          yield "    mutable #{count_type} *references = nullptr;"
+        end
+        yield ''
+        yield "    #{count_type} *AddReference( void ) const;"
+      end
+
       yield '  };' # end of class
-      yield ''
-      yield '}' # end of namespace
-      yield ''
-      yield "#endif /* #{header_guard} */"
     end
 
     # Gives each line of the declaration of the given ConstantSpec.
@@ -413,6 +829,22 @@ module Wrapture
       yield "static const #{variable};"
     end
 
+    # Gives each line of the traits struct of the given class of the family
+    # being wrapped and the alias declaring the class to the provided block.
+    def declare_family_member(member)
+      traits = @family.traits_name(member)
+      instance = "#{@spec.name}<#{traits}>"
+
+      yield "struct #{traits} {"
+      @family.traits(member).each do |field, function|
+        yield "  static constexpr auto #{field} = #{function};"
+      end
+      yield '};'
+      member.documentation { |line| yield line }
+      yield "using #{member.name} = #{instance};"
+      yield "extern template class #{instance};"
+    end
+
     # Gives each line of the declaration of a FunctionSpec to the provided
     # block.
     def declare_function(&block)
@@ -420,30 +852,366 @@ module Wrapture
         block.call(line)
       end
 
+      owner = @spec.owner
+      dynamic = !owner.is_a?(ClassSpec) || !owner.static_dispatch?
       modifier_prefix = if @spec.static?
                           'static '
-                        elsif @spec.virtual?
+                        elsif @spec.virtual? && dynamic
                           'virtual '
+                        elsif @spec.destructor? && owner.factory? && dynamic
+                          # children are deleted through the factory type
+                          'virtual ~'
                         elsif @spec.destructor?
                           '~'
                         else
                           ''
                         end
 
-      block.call("#{modifier_prefix}#{function_declaration_signature(@spec)};")
+      signature = function_declaration_signature(@spec)
+      block.call("#{function_attributes(@spec)}#{modifier_prefix}#{signature};")
+    end
+
+    # Gives each line of the deleted copy operations of a class that initializes
+    # its struct in place and cleans it up when destroyed to the provided block.
+    # Copying the struct would clean it up more than once, and moving it is not
+    # supported since it may hold pointers into itself.
+    def declare_in_place_storage
+      name = @spec.name
+
+      copy_doc = Comment.new("#{name} cannot be copied or moved, as it holds " \
+                             'the struct that it cleans up in place.')
+      copy_doc.format_as_doxygen(max_line_length: 76) { |line| yield line }
+      yield "#{name}( const #{name}& ) = delete;"
+      yield "#{name}& operator=( const #{name}& ) = delete;"
+    end
+
+    # Gives each line of the declarations making a class with a sequence a
+    # random access range over its items to the provided block. The iterator
+    # of the range is also its sentinel, and the access functions are defined
+    # inline so that each item costs no more than the call that gets it.
+    def declare_sequence(&block)
+      sequence = @spec.sequence
+      class_name = @spec.name
+      item_type = type_variable(sequence.item.resolved_return)
+      index = sequence.index_param
+      index_resolved = index.type.resolve(sequence.item)
+      index_type = type_variable(index_resolved)
+      index_param = type_variable(index_resolved, index.name)
+      count = sequence_call(sequence.count, '')
+      item = sequence_call(sequence.item, " #{index.name} ")
+
+      iterator_doc = Comment.new('A random access iterator over the items ' \
+                                 "of a #{class_name}, which is also the " \
+                                 'sentinel of its range.')
+      iterator_doc.format_as_doxygen(max_line_length: 76, &block)
+      <<~ITERATORTEXT.each_line(chomp: true, &block)
+        class Iterator {
+        public:
+          using iterator_category = std::random_access_iterator_tag;
+          using iterator_concept = std::random_access_iterator_tag;
+          using value_type = #{item_type};
+          using difference_type = std::ptrdiff_t;
+          using pointer = void;
+          using reference = #{item_type};
+
+          Iterator( void ) = default;
+          Iterator( const #{class_name} *owner, difference_type index )
+            : owner( owner ), index( index ) {}
+
+          reference operator*( void ) const {
+            return ( *this->owner )[static_cast<#{index_type}>( this->index )];
+          }
+
+          reference operator[]( difference_type offset ) const {
+            return *( *this + offset );
+          }
+
+          Iterator& operator++( void ) {
+            ++this->index;
+            return *this;
+          }
+
+          Iterator operator++( int ) {
+            Iterator previous = *this;
+            ++this->index;
+            return previous;
+          }
+
+          Iterator& operator--( void ) {
+            --this->index;
+            return *this;
+          }
+
+          Iterator operator--( int ) {
+            Iterator previous = *this;
+            --this->index;
+            return previous;
+          }
+
+          Iterator& operator+=( difference_type offset ) {
+            this->index += offset;
+            return *this;
+          }
+
+          Iterator& operator-=( difference_type offset ) {
+            this->index -= offset;
+            return *this;
+          }
+
+          friend Iterator operator+( Iterator it, difference_type offset ) {
+            return it += offset;
+          }
+
+          friend Iterator operator+( difference_type offset, Iterator it ) {
+            return it += offset;
+          }
+
+          friend Iterator operator-( Iterator it, difference_type offset ) {
+            return it -= offset;
+          }
+
+          friend difference_type operator-( const Iterator& lhs,
+                                            const Iterator& rhs ) {
+            return lhs.index - rhs.index;
+          }
+
+          friend bool operator==( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index == rhs.index;
+          }
+
+          friend bool operator!=( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index != rhs.index;
+          }
+
+          friend bool operator<( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index < rhs.index;
+          }
+
+          friend bool operator>( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index > rhs.index;
+          }
+
+          friend bool operator<=( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index <= rhs.index;
+          }
+
+          friend bool operator>=( const Iterator& lhs, const Iterator& rhs ) {
+            return lhs.index >= rhs.index;
+          }
+
+        private:
+          const #{class_name} *owner = nullptr;
+          difference_type index = 0;
+        };
+      ITERATORTEXT
+      yield ''
+
+      size_doc = Comment.new("The number of items in this #{class_name}, " \
+                             "as given by #{sequence.count.name}.")
+      size_doc.format_as_doxygen(max_line_length: 76, &block)
+      yield 'std::size_t size( void ) const {'
+      yield "  auto count = #{count};"
+      yield '  return count > 0 ? static_cast<std::size_t>( count ) : 0;'
+      yield '}'
+      yield ''
+
+      item_doc = Comment.new('The item at the given index of this ' \
+                             "#{class_name}, as given by " \
+                             "#{sequence.item.name}.")
+      item_doc.format_as_doxygen(max_line_length: 76, &block)
+      yield "#{item_type} operator[]( #{index_param} ) const {"
+      yield "  return #{item};"
+      yield '}'
+      yield ''
+
+      <<~RANGETEXT.each_line(chomp: true, &block)
+        Iterator begin( void ) const {
+          return Iterator( this, 0 );
+        }
+
+        Iterator end( void ) const {
+          return Iterator( this, static_cast<std::ptrdiff_t>( this->size() ) );
+        }
+      RANGETEXT
+    end
+
+    # Gives each line of the definition of the function adding a reference to
+    # the struct of a class with shared ownership to the provided block. This
+    # allocates the count of references if the instance has not been copied
+    # before, and gives nothing if the instance has been moved from.
+    def define_add_reference
+      template = @spec.template_parameter && template_head(@spec)
+      count_type = reference_count_type
+
+      yield template if template
+      yield "#{count_type} *#{class_name(@spec)}::AddReference( void ) const {"
+      yield '  if( !this->equivalent ) {'
+      yield '    return nullptr;'
+      yield '  }'
+      yield ''
+      if @spec.ownership == 'shared'
+        yield "  #{count_type} *references = " \
+              'this->references.load( std::memory_order_acquire );'
+        yield '  if( !references ) {'
+        yield "    #{count_type} *created = new #{count_type}( 1 );"
+        exchange = '    if( this->references.compare_exchange_strong( '
+        yield "#{exchange}references, created,"
+        yield "#{' ' * exchange.length}std::memory_order_acq_rel,"
+        yield "#{' ' * exchange.length}std::memory_order_acquire ) ) {"
+        yield '      references = created;'
+        yield '    } else {'
+        yield '      delete created;'
+        yield '    }'
+        yield '  }'
+        yield ''
+        yield '  references->fetch_add( 1, std::memory_order_relaxed );'
+        yield '  return references;'
+      else
+        yield '  if( !this->references ) {'
+        yield "    this->references = new #{count_type}( 1 );"
+        yield '  }'
+        yield ''
+        yield '  ++*this->references;'
+        yield '  return this->references;'
+      end
+      yield '}'
+    end
+
+    # Gives each line of the definitions of the asynchronous variants of the
+    # given FunctionSpec to the provided block.
+    def define_async_function(func_spec)
+      result = async_result_type(func_spec)
+      params = async_param_list(func_spec, declaration: false)
+      name = qualified_function_name(func_spec)
+      call = async_call_lambda(func_spec)
+      template = @spec.template_parameter && template_head(@spec)
+
+      yield template if template
+      yield "std::future<#{result}> #{name}Future( #{params} ) {"
+      yield "  return pool.Run<#{result}>( #{call} );"
+      yield '}'
+      yield ''
+      yield '#ifdef __cpp_impl_coroutine'
+      awaitable = "#{worker_pool_namespace}::Awaitable<#{result}>"
+      yield template if template
+      yield "#{awaitable} #{name}Async( #{params} ) {"
+      yield "  return #{awaitable}( #{call}, pool );"
+      yield '}'
+      yield '#endif'
+    end
+
+    # Gives each line of the declarations of the functions copying the struct
+    # of a serializable class to and from bytes to the provided block.
+    def declare_serialization(&block)
+      name = @spec.name
+      struct_type = "struct #{@spec.struct.name}"
+      vector_type = 'std::vector<unsigned char>'
+      docs = {
+        fingerprint: "A fingerprint of the layout of the struct wrapped by " \
+                     "#{name}, which from_bytes checks before reading the " \
+                     'bytes written by to_bytes.',
+        size: 'The number of bytes written by to_bytes. This is a header ' \
+              'holding a byte order mark, the size of the struct, and the ' \
+              'layout fingerprint, followed by the struct itself.',
+        write: "Writes this #{name} into the given buffer, which must hold " \
+               'at least serialized_size bytes.',
+        bytes: "Gives the bytes of this #{name}, as written by to_bytes.",
+        read: "Creates a #{name} from the bytes written by to_bytes. Throws " \
+              'std::invalid_argument if they are not serialized_size long, ' \
+              'or were written with a different byte order or struct layout.'
+      }
+      declarations = {
+        fingerprint: 'static constexpr std::uint64_t layout_fingerprint = ' \
+                     "#{@spec.struct.layout_fingerprint};",
+        size: 'static constexpr std::size_t serialized_size = ' \
+              "#{LAYOUT_HEADER_SIZE} + sizeof( #{struct_type} );",
+        write: 'void to_bytes( unsigned char *buffer ) const;',
+        bytes: "#{vector_type} to_bytes( void ) const;",
+        read: "static #{name} from_bytes( const unsigned char *bytes, " \
+              "std::size_t length );\n" \
+              "static #{name} from_bytes( const #{vector_type}& bytes );"
+      }
+
+      declarations.each_with_index do |(key, declaration), i|
+        yield '' unless i.zero?
+        Comment.new(docs[key]).format_as_doxygen(max_line_length: 76, &block)
+        declaration.each_line(chomp: true, &block)
+      end
+    end
+
+    # Gives each line of the declarations of the copy and move operations of a
+    # class with shared ownership to the provided block.
+    def declare_shared_ownership
+      name = @spec.name
+
+      copy_doc = Comment.new("Creates a #{name} sharing the struct of " \
+                             'another, which is destroyed along with the ' \
+                             'last instance sharing it.')
+      copy_doc.format_as_doxygen(max_line_length: 76) { |line| yield line }
+      yield "#{name}( const #{name}& other );"
+      yield "#{name}( #{name}&& other ) noexcept;"
+      yield "#{name}& operator=( #{name} other ) noexcept;"
+    end
+
+    # Gives each line of the definitions of the macros that describe the side
+    # effects of functions to the provided block. The pure and const attributes
+    # are only given to compilers that support those of GCC.
+    def define_attribute_macros
+      yield "#ifndef #{NODISCARD_MACRO}"
+      yield '  #if __cplusplus >= 201703L'
+      yield "    #define #{NODISCARD_MACRO} [[nodiscard]]"
+      yield '  #elif defined( __GNUC__ )'
+      yield "    #define #{NODISCARD_MACRO} [[gnu::warn_unused_result]]"
+      yield '  #else'
+      yield "    #define #{NODISCARD_MACRO}"
+      yield '  #endif'
+      yield '#endif'
+      yield ''
+      yield "#ifndef #{PURE_MACRO}"
+      yield '  #if defined( __GNUC__ )'
+      yield "    #define #{PURE_MACRO} [[gnu::pure]]"
+      yield "    #define #{CONST_MACRO} [[gnu::const]]"
+      yield '  #else'
+      yield "    #define #{PURE_MACRO}"
+      yield "    #define #{CONST_MACRO}"
+      yield '  #endif'
+      yield '#endif'
     end
 
     # Gives each line of the definition of a ClassSpec to the provided block.
-    def define_class
+    def define_class(&block)
       yield "#include <#{@spec.name}.hpp>"
       definition_includes.each { |inc| yield "#include <#{inc}>" }
 
+      define_class_body(&block)
+    end
+
+    # Gives each line of the definition of a ClassSpec following its includes
+    # to the provided block.
+    def define_class_body
+      actions = error_actions
+      unless actions.empty?
+        yield ''
+        define_unlikely_macro { |line| yield line }
+      end
+
       yield ''
       yield "namespace #{@spec.namespace} {"
 
+      unless actions.empty?
+        yield ''
+        yield '  namespace {'
+        actions.each_with_index do |action, i|
+          yield '' unless i.zero?
+          action.define_helper { |line| yield "    #{line}" }
+        end
+        yield '  }'
+      end
+
       yield unless @spec.constants.empty?
       @spec.constants.each do |const|
-        yield "  #{define_constant(const, @spec.name)};"
+        yield "  #{template_head(@spec)}" if @spec.template_parameter
+        yield "  #{define_constant(const, class_name(@spec))};"
       end
 
       class_functions.each do |function|
@@ -451,10 +1219,328 @@ module Wrapture
         self.class.define_spec(function) { |line| yield "  #{line}" }
       end
 
+      async_functions.each do |function|
+        yield ''
+        define_async_function(function) { |line| yield "  #{line}" }
+      end
+
+      if @spec.shared?
+        yield ''
+        define_shared_ownership do |line|
+          yield line.empty? ? line : "  #{line}"
+        end
+      end
+
+      if @spec.serializable?
+        yield ''
+        define_serialization { |line| yield line.empty? ? line : "  #{line}" }
+      end
+
+      @family&.members&.each do |member|
+        yield ''
+        define_family_member(member) { |line| yield "  #{line}" }
+      end
+
       yield ''
       yield '}' # end of namespace
     end
 
+    # Gives each line of the definition of a ClassSpec as an implementation
+    # unit of the module of its scope to the provided block. The includes are
+    # placed in the global module fragment so that the declarations of the
+    # wrapped library stay attached to the global module. Those of the
+    # interface unit are repeated, as they are not visible to the unit.
+    def define_class_module_unit(&block)
+      includes = module_interface_includes + definition_includes
+      includes = global_fragment_includes(includes)
+      unless includes.empty?
+        yield 'module;'
+        yield ''
+        includes.each { |inc| yield "#include <#{inc}>" }
+        yield ''
+      end
+
+      yield "module #{@spec.scope.name};"
+      define_class_body(&block)
+    end
+
+    # Gives each line of a CMakeLists.txt for this scope to the provided block.
+    # If +modules+ is true, the module interface unit is built in a
+    # CXX_MODULES file set, which needs CMake 3.28 or later.
+    #
+    # The library target can be tuned with cache options prefixed with the
+    # scope name, such as KITCHEN_IPO, and is installed along with a package
+    # configuration so that other projects can find it with find_package.
+    def define_cmake(modules: false)
+      headers = []
+      sources = []
+
+      source_files(modules: modules).each do |source|
+        headers.append(source) if source.end_with?('.hpp')
+        sources.append(source) if source.end_with?('.cpp')
+      end
+      sources.concat(@spec.build['sources'])
+
+      yield "cmake_minimum_required(VERSION #{modules ? '3.28' : '3.16'})"
+      yield "project(#{@spec.name})"
+      yield ''
+
+      define_cmake_options(modules: modules) { |line| yield line }
+      yield 'include(GNUInstallDirs)'
+      yield ''
+
+      if modules
+        define_cmake_module_library(sources) { |line| yield line }
+        return
+      end
+
+      header_list = "#{@spec.name.upcase}_HEADERS"
+      yield "set(#{header_list}"
+      headers.each do |source|
+        yield "  #{source}"
+      end
+      yield ')'
+      yield ''
+
+      # each header is compiled on its own to catch any missing includes
+      check_target = "#{@spec.name}_header_check"
+      check_list = "#{@spec.name.upcase}_HEADER_CHECK_SOURCES"
+      yield "set(#{check_list})"
+      yield "foreach(header ${#{header_list}})"
+      yield '  get_filename_component(header_name ${header} NAME_WE)'
+      yield '  set(check_source ' \
+            '${CMAKE_CURRENT_BINARY_DIR}/header_check/${header_name}.cpp)'
+      yield '  file(WRITE ${check_source} "#include <${header}>\\n")'
+      yield "  list(APPEND #{check_list} ${check_source})"
+      yield 'endforeach()'
+      yield "add_library(#{check_target} OBJECT EXCLUDE_FROM_ALL " \
+            "${#{check_list}})"
+      yield "target_include_directories(#{check_target} PRIVATE " \
+            "${CMAKE_CURRENT_SOURCE_DIR}#{cmake_include_dirs})"
+      yield ''
+
+      if sources.empty?
+        yield "add_library(#{@spec.name} INTERFACE)"
+        yield "target_include_directories(#{@spec.name} INTERFACE"
+        yield '  $<BUILD_INTERFACE:${CMAKE_CURRENT_SOURCE_DIR}>'
+        yield '  $<INSTALL_INTERFACE:${CMAKE_INSTALL_INCLUDEDIR}>'
+        yield ')'
+        yield ''
+      else
+        source_list = "#{@spec.name.upcase}_SOURCES"
+        yield "set(#{source_list}"
+        sources.each do |source|
+          yield "  #{source}"
+        end
+        yield ')'
+        yield ''
+
+        lib_deps = define_cmake_link_targets { |line| yield line }
+        library_type = "${#{@spec.name.upcase}_LIBRARY_TYPE}"
+        yield "add_library(#{@spec.name} #{library_type} ${#{source_list}})"
+        yield "target_include_directories(#{@spec.name} PUBLIC"
+        yield '  $<BUILD_INTERFACE:${CMAKE_CURRENT_SOURCE_DIR}>'
+        yield '  $<INSTALL_INTERFACE:${CMAKE_INSTALL_INCLUDEDIR}>'
+        yield ')'
+        unless @spec.build['include-dirs'].empty?
+          yield "target_include_directories(#{@spec.name} PRIVATE" \
+                "#{cmake_include_dirs})"
+        end
+        unless lib_deps.empty?
+          yield "target_link_libraries(#{@spec.name} PRIVATE #{lib_deps})"
+        end
+        yield ''
+
+        define_cmake_target_options { |line| yield line }
+      end
+
+      define_cmake_install(header_list) { |line| yield line }
+    end
+
+    # Gives each line of the package configuration file installed with the
+    # library of this scope to the provided block. The imported targets of the
+    # wrapped libraries are recreated before the exported targets are loaded,
+    # since a static wrapper library still needs to link to them.
+    def define_cmake_config
+      yield "if(NOT TARGET #{@spec.name}::#{@spec.name})"
+      define_cmake_link_targets { |line| yield line.empty? ? '' : "  #{line}" }
+      yield '  include(${CMAKE_CURRENT_LIST_DIR}/' \
+            "#{@spec.name}Targets.cmake)"
+      yield 'endif()'
+    end
+
+    # Gives each line of the install commands for the library of this scope
+    # and the given list of headers to the provided block. The headers are
+    # left out when building a module, which installs its interface unit
+    # instead.
+    def define_cmake_install(header_list = nil)
+      package_dir = "${CMAKE_INSTALL_LIBDIR}/cmake/#{@spec.name}"
+
+      yield "install(TARGETS #{@spec.name} EXPORT #{@spec.name}Targets"
+      yield '  ARCHIVE DESTINATION ${CMAKE_INSTALL_LIBDIR}'
+      yield '  LIBRARY DESTINATION ${CMAKE_INSTALL_LIBDIR}'
+      yield '  RUNTIME DESTINATION ${CMAKE_INSTALL_BINDIR}'
+      yield '  OBJECTS DESTINATION ${CMAKE_INSTALL_LIBDIR}'
+      unless header_list
+        yield '  FILE_SET CXX_MODULES DESTINATION ' \
+              "${CMAKE_INSTALL_INCLUDEDIR}/#{@spec.name}"
+      end
+      yield ')'
+      if header_list
+        yield "install(FILES ${#{header_list}} " \
+              'DESTINATION ${CMAKE_INSTALL_INCLUDEDIR})'
+      end
+      yield "install(EXPORT #{@spec.name}Targets"
+      yield "  NAMESPACE #{@spec.name}::"
+      yield "  DESTINATION #{package_dir}"
+      yield '  CXX_MODULES_DIRECTORY cxx-modules' unless header_list
+      yield ')'
+      yield 'install(FILES ' \
+            "${CMAKE_CURRENT_SOURCE_DIR}/#{cmake_config_filename}"
+      yield "  DESTINATION #{package_dir}"
+      yield ')'
+    end
+
+    # Gives each line of the imported targets of the libraries that this scope
+    # links to to the provided block, returning the list of targets to link.
+    #
+    # The libraries are imported with an unknown type so that static archives
+    # may be used as well, which the +static+ build option of the scope
+    # prefers. They are not linked at all if the scope gives the sources of
+    # the library to build instead.
+    def define_cmake_link_targets
+      build = @spec.build
+      lib_targets = []
+      libraries = build['sources'].empty? ? @spec.libraries : []
+      hints = build['library-dirs'].map { |dir| " #{dir}" }.join
+      hints = " HINTS#{hints}" unless hints.empty?
+
+      libraries.each do |lib|
+        target_name = "#{@spec.name}_#{lib}"
+        names = if build['static']
+                  '${CMAKE_STATIC_LIBRARY_PREFIX}' \
+                    "#{lib}${CMAKE_STATIC_LIBRARY_SUFFIX} #{lib}"
+                else
+                  lib
+                end
+        yield "find_library(LIB#{lib.upcase}_FOUND NAMES #{names}#{hints})"
+        yield "add_library(#{target_name} UNKNOWN IMPORTED)"
+        yield "set_target_properties(#{target_name} PROPERTIES"
+        yield "  IMPORTED_LOCATION ${LIB#{lib.upcase}_FOUND}"
+        yield ')'
+        yield ''
+
+        lib_targets.append(target_name)
+      end
+
+      if async?
+        yield 'find_package(Threads REQUIRED)'
+        yield ''
+        lib_targets.append('Threads::Threads')
+      end
+
+      lib_targets.join(' ')
+    end
+
+    # Gives each line of the library target building this scope as a module
+    # from the given implementation units to the provided block.
+    def define_cmake_module_library(sources)
+      module_list = "#{@spec.name.upcase}_MODULES"
+      yield "set(#{module_list}"
+      yield "  #{module_interface_filename}"
+      yield ')'
+      yield ''
+
+      source_list = "#{@spec.name.upcase}_SOURCES"
+      yield "set(#{source_list}"
+      sources.each { |source| yield "  #{source}" }
+      yield ')'
+      yield ''
+
+      lib_deps = define_cmake_link_targets { |line| yield line }
+      yield "add_library(#{@spec.name} ${#{@spec.name.upcase}_LIBRARY_TYPE})"
+      yield "target_sources(#{@spec.name}"
+      yield "  PUBLIC FILE_SET CXX_MODULES FILES ${#{module_list}}"
+      yield "  PRIVATE ${#{source_list}}"
+      yield ')'
+      yield "target_compile_features(#{@spec.name} PUBLIC cxx_std_20)"
+      yield "target_include_directories(#{@spec.name} PRIVATE " \
+            "${CMAKE_CURRENT_SOURCE_DIR}#{cmake_include_dirs})"
+      unless lib_deps.empty?
+        yield "target_link_libraries(#{@spec.name} PRIVATE #{lib_deps})"
+      end
+      yield ''
+
+      define_cmake_target_options(modules: true) { |line| yield line }
+      define_cmake_install { |line| yield line }
+    end
+
+    # Gives each line of the cache options for building the library of this
+    # scope to the provided block. Unity builds and precompiled headers are
+    # not offered for modules. The +optimize+ build option of the scope turns
+    # interprocedural optimization and hidden visibility on by default.
+    def define_cmake_options(modules: false)
+      prefix = @spec.name.upcase
+      optimize = @spec.build['optimize'] ? 'ON' : 'OFF'
+
+      unless modules
+        yield "option(#{prefix}_UNITY_BUILD " \
+              '"Build the wrapper sources as a single unit." OFF)'
+      end
+      yield "option(#{prefix}_IPO " \
+            "\"Build with interprocedural optimization.\" #{optimize})"
+      yield "option(#{prefix}_HIDDEN_VISIBILITY " \
+            "\"Export only the wrapper classes.\" #{optimize})"
+      unless modules
+        yield "option(#{prefix}_PRECOMPILE_HEADERS " \
+              '"Precompile the headers of the wrapped library." OFF)'
+      end
+      yield "set(#{prefix}_LIBRARY_TYPE \"\" CACHE STRING " \
+            '"STATIC, SHARED, OBJECT, or empty to follow BUILD_SHARED_LIBS.")'
+      yield "set_property(CACHE #{prefix}_LIBRARY_TYPE " \
+            'PROPERTY STRINGS "" STATIC SHARED OBJECT)'
+      yield ''
+    end
+
+    # Gives each line applying the cache options of this scope to its library
+    # target to the provided block.
+    def define_cmake_target_options(modules: false)
+      prefix = @spec.name.upcase
+
+      unless modules
+        yield "set_target_properties(#{@spec.name} PROPERTIES " \
+              "UNITY_BUILD ${#{prefix}_UNITY_BUILD})"
+        yield ''
+      end
+
+      yield "if(#{prefix}_IPO)"
+      yield '  include(CheckIPOSupported)'
+      yield '  check_ipo_supported()'
+      yield "  set_target_properties(#{@spec.name} PROPERTIES " \
+            'INTERPROCEDURAL_OPTIMIZATION ON)'
+      yield 'endif()'
+      yield ''
+
+      yield "if(#{prefix}_HIDDEN_VISIBILITY)"
+      yield "  set_target_properties(#{@spec.name} PROPERTIES"
+      yield '    C_VISIBILITY_PRESET hidden'
+      yield '    CXX_VISIBILITY_PRESET hidden'
+      yield '    VISIBILITY_INLINES_HIDDEN ON'
+      yield '  )'
+      yield 'endif()'
+      yield ''
+
+      library_headers = @spec.definition_includes
+      return if modules || library_headers.empty?
+
+      yield "if(#{prefix}_PRECOMPILE_HEADERS)"
+      yield "  target_precompile_headers(#{@spec.name} PRIVATE"
+      library_headers.each { |header| yield "    <#{header}>" }
+      yield '  )'
+      yield 'endif()'
+      yield ''
+    end
+
     # Gives each line of the definition of a ConstantSpec in a given class to
     # the provided block.
     def define_constant(constant_spec, class_name)
@@ -462,6 +1548,24 @@ module Wrapture
       "const #{constant_spec.type} #{expanded_name} = #{constant_spec.value}"
     end
 
+    # Gives each line of a branch of a statically dispatched function that
+    # runs the given override when the struct matches the rules of its class.
+    def define_dispatch_branch(overload, override)
+      target = if @spec.owner.pointer_wrapper?
+                 'this->equivalent'
+               else
+                 '( &this->equivalent )'
+               end
+
+      yield "if( #{overload.struct.rules_check(target)} ){"
+      # the body is private to each wrapper, so it is reached through send
+      self.class.new(override).send(:define_function_body) do |line|
+        yield "  #{line}" unless line.nil? || line.empty?
+      end
+      yield '  return;' if @spec.return_type.name == 'void'
+      yield '}'
+    end
+
     # Gives each line of the definition of a EnumSpec to the provided block.
     def define_enum
       indent = 0
@@ -481,6 +1585,16 @@ module Wrapture
         indent += 2
       end
 
+      define_enum_body(indent) { |line| yield line }
+      yield
+      yield '}' if @spec.namespace?
+      yield
+      yield "#endif /* #{header_guard} */"
+    end
+
+    # Gives each line of the enum itself to the provided block, indented by
+    # the given number of spaces.
+    def define_enum_body(indent)
       @spec.doc.format_as_doxygen(max_line_length: 76) do |line|
         yield "#{' ' * indent}#{line}"
       end
@@ -499,10 +1613,40 @@ module Wrapture
 
       indent -= 2
       yield "#{' ' * indent}};"
-      yield
-      yield '}' if @spec.namespace?
-      yield
-      yield "#endif /* #{header_guard} */"
+    end
+
+    # Gives each line of the definition of the macro that gives the classes of
+    # a scope default visibility to the provided block, so that they are still
+    # exported when the library is built with hidden visibility.
+    def define_export_macro
+      attribute = '__attribute__(( visibility( "default" ) ))'
+
+      yield "#ifndef #{EXPORT_MACRO}"
+      yield '  #if defined( __GNUC__ )'
+      yield "    #define #{EXPORT_MACRO} #{attribute}"
+      yield '  #else'
+      yield "    #define #{EXPORT_MACRO}"
+      yield '  #endif'
+      yield '#endif'
+    end
+
+    # Gives each line of the explicit instantiation of the class template for
+    # the given class of the family being wrapped to the provided block.
+    def define_family_member(member)
+      traits = @family.traits_name(member)
+      fields = @family.traits(member)
+
+      # static constexpr members are only implicitly inline from C++17 on
+      unless fields.empty?
+        yield '#if __cplusplus < 201703L'
+        fields.each do |field, _|
+          yield "constexpr decltype( #{traits}::#{field} ) " \
+                "#{traits}::#{field};"
+        end
+        yield '#endif'
+      end
+
+      yield "template class #{@spec.name}<#{traits}>;"
     end
 
     # Gives each line of the definition of a FunctionSpec to the provided
@@ -511,47 +1655,326 @@ module Wrapture
       @spec.definable!
 
       signature = function_definition_signature(@spec)
+      owner = @spec.owner
 
+      if owner.is_a?(ClassSpec) && owner.template_parameter
+        yield template_head(owner)
+      end
       yield "#{signature} #{initializer_suffix}{"
+      define_function_body { |line| yield line.nil? ? '' : "  #{line}" }
+      yield '}'
+    end
 
-      function_locals(@spec) { |declaration| yield "  #{declaration}" }
-      yield ''
+    # Gives each line of the body of the definition of a FunctionSpec to the
+    # provided block, without the enclosing braces or indentation. Lines
+    # separating the parts of the body are given as nil.
+    def define_function_body
+      @spec.definable!
+
+      if @spec.destructor? && @spec.owner.shared?
+        define_reference_release { |line| yield line }
+      end
+
+      dispatch_overrides(@spec).each_with_index do |(overload, override), i|
+        yield unless i.zero?
+        define_dispatch_branch(overload, override) { |line| yield line }
+      end
+
+      function_locals(@spec) { |declaration| yield declaration }
+      yield
 
       if @spec.variadic?
-        yield "  va_start( variadic_args, #{@spec.params[-2].name} );"
-        yield ''
+        yield "va_start( variadic_args, #{@spec.params[-2].name} );"
+        yield
       end
 
       if @spec.wrapped.is_a?(WrappedFunctionSpec)
-        yield "  #{wrapped_call_expression};"
+        yield "#{wrapped_call_expression};"
       else
-        @spec.wrapped.lines.each { |line| yield "  #{line}" }
+        @spec.wrapped.lines.each { |line| yield line }
       end
 
       if @spec.wrapped.error_check?
-        yield ''
+        yield
         @spec.wrapped.error_check(return_val: return_variable) do |line|
-          yield "  #{line}"
+          yield line
         end
       end
 
-      yield '  va_end( variadic_args );' if @spec.variadic?
+      yield 'va_end( variadic_args );' if @spec.variadic?
 
-      yield "  #{return_statement}"
+      yield return_statement
+    end
 
+    # Gives each line of the interface unit of the module of a scope to the
+    # provided block, which exports every class and enum of the scope.
+    def define_module_interface
+      yield 'module;'
+      yield ''
+      includes = module_interface_includes
+      unless includes.empty?
+        includes.each { |inc| yield "#include <#{inc}>" }
+        yield ''
+      end
+      define_export_macro { |line| yield line }
+      yield ''
+      if function_attributes?
+        define_attribute_macros { |line| yield line }
+        yield ''
+      end
+
+      yield "export module #{@spec.name};"
+
+      specs = @spec.enums + @spec.classes_in_creation_order
+      specs.group_by(&:namespace).each do |namespace, members|
+        yield ''
+        yield namespace ? "export namespace #{namespace} {" : 'export {'
+
+        # the classes may use one another before they are defined
+        classes = members.select { |spec| spec.is_a?(ClassSpec) }
+        if classes.length > 1
+          yield ''
+          classes.each { |class_spec| yield "  class #{class_spec.name};" }
+        end
+
+        members.each do |spec|
+          yield ''
+          self.class.new(spec).export { |line| yield line }
+        end
+
+        yield ''
+        yield '}'
+      end
+    end
+
+    # Gives each line of the check at the start of the destructor of a class
+    # with shared ownership to the provided block, which drops the reference
+    # of the instance and returns unless it was the last one.
+    def define_reference_release
+      atomic = @spec.owner.ownership == 'shared'
+      count_type = atomic ? 'std::atomic<long>' : 'long'
+      references = if atomic
+                     'this->references.load( std::memory_order_acquire )'
+                   else
+                     'this->references'
+                   end
+      last = if atomic
+               'references->fetch_sub( 1, std::memory_order_acq_rel ) != 1'
+             else
+               '--*references != 0'
+             end
+
+      yield 'if( !this->equivalent ) {'
+      yield '  return;'
+      yield '}'
+      yield ''
+      yield "#{count_type} *references = #{references};"
+      yield 'if( references ) {'
+      yield "  if( #{last} ) {"
+      yield '    return;'
+      yield '  }'
+      yield '  delete references;'
       yield '}'
     end
 
+    # Gives each line of the definitions of the functions copying the struct of
+    # a serializable class to and from bytes to the provided block.
+    #
+    # The struct is copied with memcpy after a header that lets from_bytes
+    # reject bytes written by a machine with a different byte order or for a
+    # different layout of the struct.
+    def define_serialization(&block)
+      template = @spec.template_parameter && "#{template_head(@spec)}\n"
+      name = @spec.name
+      qualified_name = class_name(@spec)
+      struct_type = "struct #{@spec.struct.name}"
+      header_size = LAYOUT_HEADER_SIZE
+      vector_type = 'std::vector<unsigned char>'
+      read_params = 'const unsigned char *bytes, std::size_t length'
+      length_error = "the bytes of a #{name} must be serialized_size long"
+      byte_order_error = "the bytes of the #{name} were written with a " \
+                         'different byte order'
+      layout_error = "the bytes of the #{name} were written for a different " \
+                     'struct layout'
+
+      <<~CPPTEXT.each_line(chomp: true, &block)
+        #{template}void
+        #{qualified_name}::to_bytes( unsigned char *buffer ) const {
+          const std::uint32_t byte_order = #{BYTE_ORDER_MARK};
+          const std::uint32_t struct_size = sizeof( this->equivalent );
+          const std::uint64_t fingerprint = layout_fingerprint;
+
+          std::memcpy( buffer, &byte_order, 4 );
+          std::memcpy( buffer + 4, &struct_size, 4 );
+          std::memcpy( buffer + 8, &fingerprint, 8 );
+          std::memcpy( buffer + #{header_size}, &this->equivalent,
+                       sizeof( this->equivalent ) );
+        }
+
+        #{template}#{vector_type}
+        #{qualified_name}::to_bytes( void ) const {
+          #{vector_type} bytes( serialized_size );
+
+          this->to_bytes( bytes.data() );
+          return bytes;
+        }
+
+        #{template}#{qualified_name}
+        #{qualified_name}::from_bytes( #{read_params} ) {
+          static_assert( std::is_trivially_copyable<#{struct_type}>::value,
+                         "#{name} must wrap a trivially copyable struct" );
+          std::uint32_t byte_order;
+          std::uint32_t struct_size;
+          std::uint64_t fingerprint;
+          #{struct_type} equivalent;
+
+          if( length != serialized_size ) {
+            throw std::invalid_argument( "#{length_error}" );
+          }
+
+          std::memcpy( &byte_order, bytes, 4 );
+          std::memcpy( &struct_size, bytes + 4, 4 );
+          std::memcpy( &fingerprint, bytes + 8, 8 );
+
+          if( byte_order != #{BYTE_ORDER_MARK} ) {
+            throw std::invalid_argument( "#{byte_order_error}" );
+          }
+
+          if( struct_size != sizeof( equivalent ) ||
+              fingerprint != layout_fingerprint ) {
+            throw std::invalid_argument( "#{layout_error}" );
+          }
+
+          std::memcpy( &equivalent, bytes + #{header_size},
+                       sizeof( equivalent ) );
+          #{qualified_name} result( &equivalent );
+          result.equivalent = equivalent;
+          return result;
+        }
+
+        #{template}#{qualified_name}
+        #{qualified_name}::from_bytes( const #{vector_type}& bytes ) {
+          return from_bytes( bytes.data(), bytes.size() );
+        }
+      CPPTEXT
+    end
+
+    # Gives each line of the definitions of the copy and move operations of a
+    # class with shared ownership to the provided block.
+    def define_shared_ownership(&block)
+      template = @spec.template_parameter && template_head(@spec)
+      name = @spec.name
+      qualified_name = class_name(@spec)
+      atomic = @spec.ownership == 'shared'
+
+      yield template if template
+      yield "#{qualified_name}::#{name}( const #{name}& other )"
+      yield '  : equivalent( other.equivalent ), ' \
+            'references( other.AddReference() ) {}'
+      yield ''
+      yield template if template
+      yield "#{qualified_name}::#{name}( #{name}&& other ) noexcept"
+      if atomic
+        yield '  : equivalent( other.equivalent ),'
+        yield '    references( other.references.exchange( nullptr, ' \
+              'std::memory_order_relaxed ) ) {'
+      else
+        yield '  : equivalent( other.equivalent ), ' \
+              'references( other.references ) {'
+        yield '  other.references = nullptr;'
+      end
+      yield '  other.equivalent = nullptr;'
+      yield '}'
+      yield ''
+      yield template if template
+      yield "#{qualified_name}& #{qualified_name}::operator=( " \
+            "#{name} other ) noexcept {"
+      yield '  std::swap( this->equivalent, other.equivalent );'
+      if atomic
+        yield "  #{reference_count_type} *references = " \
+              'this->references.load( std::memory_order_relaxed );'
+        yield '  this->references.store( other.references.load( ' \
+              'std::memory_order_relaxed ),'
+        yield '                          std::memory_order_relaxed );'
+        yield '  other.references.store( references, ' \
+              'std::memory_order_relaxed );'
+      else
+        yield '  std::swap( this->references, other.references );'
+      end
+      yield '  return *this;'
+      yield '}'
+      yield ''
+      define_add_reference(&block)
+    end
+
+    # Gives each line of the definition of the macro that marks the condition
+    # of an error check as unlikely to the provided block. This uses the
+    # unlikely attribute from C++20 on, and __builtin_expect before that when
+    # it is available.
+    def define_unlikely_macro
+      macro = "#{UNLIKELY_MACRO}( condition )"
+
+      yield "#ifndef #{UNLIKELY_MACRO}"
+      yield '  #if __cplusplus >= 202002L'
+      yield "    #define #{macro} ( condition ) [[unlikely]]"
+      yield '  #elif defined( __GNUC__ )'
+      yield "    #define #{macro} ( __builtin_expect( !!( condition ), 0 ) )"
+      yield '  #else'
+      yield "    #define #{macro} ( condition )"
+      yield '  #endif'
+      yield '#endif'
+    end
+
     # A list of includes needed for the definition of the class.
     def definition_includes
       includes = @spec.definition_includes
       includes.concat(common_includes(@spec))
+      includes << 'utility' unless error_actions.empty? && !@spec.shared?
+      includes.concat(%w[cstring stdexcept type_traits]) if @spec.serializable?
 
       @spec.scope.overloads(@spec).map do |overload|
-        includes.append("#{overload.name}.hpp")
+        includes.append(self.class.declaration_filename(overload))
       end
 
-      includes
+      dispatched_functions.each do |func|
+        includes.concat(func.definition_includes)
+      end
+
+      includes.uniq
+    end
+
+    # A list of pairs of the overloads of the class of the given FunctionSpec
+    # and their functions that the function dispatches to statically. This is
+    # empty unless the function is virtual and its class uses static dispatch.
+    def dispatch_overrides(func_spec)
+      owner = func_spec.owner
+      return [] unless func_spec.virtual? && owner.is_a?(ClassSpec) &&
+                       owner.static_dispatch?
+
+      owner.scope.overloads(owner).each_with_object([]) do |overload, pairs|
+        override = overload.method_specs.find do |method|
+          method.name == func_spec.name &&
+            method.params.length == func_spec.params.length
+        end
+        next unless override
+
+        if overload.equivalent_member?
+          raise WrapError, "#{overload.name} cannot be statically dispatched " \
+                           'to as it does not share the struct of its parent'
+        end
+
+        pairs << [overload, override]
+      end
+    end
+
+    # A list of the functions of overloads that the functions of this class
+    # dispatch to statically.
+    def dispatched_functions
+      return [] unless @spec.is_a?(ClassSpec) && @spec.static_dispatch?
+
+      class_functions.flat_map do |func|
+        dispatch_overrides(func).map(&:last)
+      end
     end
 
     # The definition of an enum element.
@@ -584,6 +2007,15 @@ module Wrapture
       "this->equivalent#{@spec.pointer_wrapper? ? '->' : '.'}#{field_name}"
     end
 
+    # The ActionSpecs taken by the error checks of the class functions, with
+    # only one for each helper function.
+    def error_actions
+      functions = class_functions + dispatched_functions
+      actions = functions.map { |func| func.wrapped&.error_action }
+
+      actions.compact.uniq(&:helper_name)
+    end
+
     # A spec hash for a factory constructor for this class.
     #
     # A factory constructor creates an instance of a class based on a struct
@@ -591,16 +2023,21 @@ module Wrapture
     def factory_constructor_hash
       factory_lines = []
       line_prefix = ''
-      @spec.scope.overloads(@spec).each do |overload|
+      overloads = @spec.static_dispatch? ? [] : @spec.scope.overloads(@spec)
+      overloads.each do |overload|
         check = overload.struct.rules_check('equivalent')
         factory_lines << "#{line_prefix}if( #{check} ) {"
         factory_lines << "  return new #{overload.name}( equivalent );"
         line_prefix = '} else '
       end
 
-      factory_lines << "#{line_prefix}{"
-      factory_lines << "  return new #{@spec.name}( equivalent );"
-      factory_lines << '}'
+      if overloads.empty?
+        factory_lines << "return new #{@spec.name}( equivalent );"
+      else
+        factory_lines << "#{line_prefix}{"
+        factory_lines << "  return new #{@spec.name}( equivalent );"
+        factory_lines << '}'
+      end
 
       { 'name' => "new#{@spec.name}",
         'static' => true,
@@ -610,6 +2047,82 @@ module Wrapture
         'return' => { 'type' => "#{@spec.name} *" } }
     end
 
+    # A list of the names of the classes of the same namespace that the
+    # declaration of the class only uses through a pointer or reference.
+    def forward_declared_classes
+      declaration_requirements.select { |kind, _| kind == :class }.map(&:last)
+    end
+
+    # A list of the names of the structs that the declaration of the class only
+    # uses through a pointer or reference. This is empty if the headers of the
+    # wrapped library are included, as they already declare them.
+    def forward_declared_structs
+      requirements = declaration_requirements
+      return [] if @family || library_declarations_needed?(requirements)
+
+      structs = requirements.select { |kind, _| kind == :struct }.map(&:last)
+      structs.unshift(@spec.struct_name) if @spec.equivalent_member?
+      structs.uniq
+    end
+
+    # A list of the includes given only for the parameter and return types of
+    # the functions of the class that its declaration forward declares, where
+    # +kinds+ are the kinds of type requirements that are forward declared.
+    # These are left to the definition of the class.
+    def forward_declared_type_includes(kinds)
+      forwarded = []
+      kept = []
+
+      class_functions.each do |func_spec|
+        typed = func_spec.params.map do |param|
+          [param.type.resolve(func_spec), param.includes]
+        end
+        typed << [func_spec.resolved_return, func_spec.return_includes]
+
+        typed.each do |type, includes|
+          forward = forward_declared_type?(type, kinds)
+          (forward ? forwarded : kept).concat(includes)
+        end
+      end
+
+      forwarded.uniq - kept
+    end
+
+    # True if the given TypeSpec only needs forward declarations of the given
+    # +kinds+ of type requirements in the declaration of the class.
+    def forward_declared_type?(type, kinds)
+      requirements = type_requirements(type)
+
+      !requirements.empty? &&
+        requirements.all? { |kind, _| kinds.include?(kind) }
+    end
+
+    # The attributes describing the side effects of the given FunctionSpec to
+    # prefix its declaration with, each followed by a space.
+    def function_attributes(func_spec)
+      attributes = String.new
+      attributes << "#{NODISCARD_MACRO} " if func_spec.side_effect_free?
+      if func_spec.const?
+        attributes << "#{CONST_MACRO} "
+      elsif func_spec.pure?
+        attributes << "#{PURE_MACRO} "
+      end
+      attributes
+    end
+
+    # True if any function of the spec of this wrapper has attributes
+    # describing its side effects.
+    def function_attributes?
+      case @spec
+      when Scope
+        @spec.classes.flat_map(&:functions).any?(&:side_effect_free?)
+      when ClassSpec
+        @spec.functions.any?(&:side_effect_free?)
+      else
+        false
+      end
+    end
+
     # The parameter list for the function declaration.
     def function_declaration_param_list(func_spec)
       if func_spec.params.empty?
@@ -676,6 +2189,15 @@ module Wrapture
       end
     end
 
+    # The given includes without the headers generated for the specs of the
+    # scope, which are replaced by the module itself.
+    def global_fragment_includes(includes)
+      scope = @spec.is_a?(Scope) ? @spec : @spec.scope
+      generated = scope.map { |spec| self.class.declaration_filename(spec) }
+
+      includes.uniq - generated
+    end
+
     # The suffix to add to a function definition for initializers, if any exist.
     def initializer_suffix
       return '' if @spec.initializers.empty?
@@ -692,6 +2214,18 @@ module Wrapture
       ": #{expressions.join(', ')} "
     end
 
+    # True if the declaration of the class needs the headers of the wrapped
+    # library, given the +requirements+ of its types. This is the case if it
+    # holds the equivalent struct by value, calls the wrapped functions from
+    # the range of its sequence, or uses a type that cannot be forward
+    # declared.
+    def library_declarations_needed?(requirements)
+      return true if @spec.equivalent_member? && !@spec.pointer_wrapper?
+      return true if @spec.sequence && sequence_inlined?
+
+      requirements.include?([:library])
+    end
+
     # A spec hash for a member constructor for this class.
     def member_constructor_hash
       assignments = @spec.struct.members.map do |member|
@@ -703,6 +2237,20 @@ module Wrapture
         'wrapped-code' => { 'lines' => assignments } }
     end
 
+    # Gives +value+, a pointer to a new instance of the return type, in the
+    # form needed by the return ownership.
+    def owner_cast(value)
+      case @spec.return_ownership
+      when 'unique_ptr'
+        "std::unique_ptr<#{@spec.return_type.base}>( #{value} )"
+      when 'value'
+        raise WrapError, "#{@spec.name} cannot return by value the pointer " \
+                         'given by its wrapped function'
+      else
+        value
+      end
+    end
+
     # A spec hash for a pointer constructor for this class.
     def pointer_constructor_hash
       assignments = if @spec.pointer_wrapper?
@@ -729,22 +2277,35 @@ module Wrapture
     # The name of the given function with its class name, if it exists.
     def qualified_function_name(function_spec)
       if function_spec.owner.is_a?(ClassSpec)
+        owner_name = class_name(function_spec.owner)
         if function_spec.destructor?
-          "#{function_spec.owner.name}::~#{function_spec.name}"
+          "#{owner_name}::~#{function_spec.name}"
         else
-          "#{function_spec.owner.name}::#{function_spec.name}"
+          "#{owner_name}::#{function_spec.name}"
         end
       else
         function_spec.name
       end
     end
 
+    # The type of the count of references to the struct of a class with shared
+    # ownership.
+    def reference_count_type
+      @spec.ownership == 'shared' ? 'std::atomic<long>' : 'long'
+    end
+
     # A function to use to create the return value of a function.
     def return_cast(value)
+      class_name = @spec.return_type.base unless @spec.return_type.function?
+
       if @spec.return_type == @spec.wrapped.return_val_type
-        value
+        owner_cast(value)
       elsif @spec.return_overloaded?
-        "new#{@spec.return_type.name.chomp('*').strip} ( #{value} )"
+        owner_cast("new#{class_name} ( #{value} )")
+      elsif @spec.return_ownership == 'value'
+        "#{class_name}( #{value} )"
+      elsif @spec.return_ownership == 'unique_ptr'
+        owner_cast("new #{class_name}( #{value} )")
       else
         return_type = @spec.resolved_return
         "( #{type_variable(return_type)} )( #{value} )"
@@ -773,7 +2334,8 @@ module Wrapture
 
       ret_part << ' ' unless current_type.pointer?
       param_list = function_definition_param_list(func_spec)
-      "#{ret_part}#{name_part}( #{param_list} )#{param_part}"
+      qualifier = const_member?(func_spec) ? ' const' : ''
+      "#{ret_part}#{name_part}( #{param_list} )#{qualifier}#{param_part}"
     end
 
     # The return statement used in this function's definition.
@@ -781,7 +2343,11 @@ module Wrapture
       if @spec.return_type.self_reference?
         'return *this;'
       elsif @spec.return_type.name != 'void' && !@spec.returns_call_directly?
-        'return return_val;'
+        if @spec.return_overloaded? || @spec.return_ownership != 'raw'
+          "return #{return_cast('return_val')};"
+        else
+          'return return_val;'
+        end
       else
         ''
       end
@@ -789,13 +2355,77 @@ module Wrapture
 
     # The name of the variable holding the return value.
     def return_variable
-      if @spec.constructor?
+      if @spec.constructor? && !@spec.in_place?
         'this->equivalent'
       else
         'return_val'
       end
     end
 
+    # The specs of the scope that are wrapped in their own files. Unless
+    # +modules+ is true, the classes wrapped as a class template are replaced
+    # by the ClassFamilySpec of their template, in place of the first of them.
+    def scope_specs(modules)
+      return @spec.to_a if modules
+
+      families = @spec.class_families
+      @spec.each_with_object([]) do |spec, specs|
+        family = families.find { |candidate| candidate.members.include?(spec) }
+        if family.nil?
+          specs << spec
+        elsif family.members.first.equal?(spec)
+          specs << family
+        end
+      end
+    end
+
+    # The expression calling the given function of the sequence of the class
+    # with the given arguments from the const members of its range.
+    #
+    # The wrapped function is called directly if this is possible from a const
+    # member, which is the case for pointer wrappers and functions that are
+    # const members themselves. Other functions are called on a non-const
+    # this, as reading the sequence is not expected to modify the instance.
+    def sequence_call(func_spec, args)
+      inline = sequence_inline_expression(func_spec)
+      return inline if inline
+
+      receiver = if const_member?(func_spec)
+                   'this'
+                 else
+                   "const_cast<#{@spec.name} *>( this )"
+                 end
+      "#{receiver}->#{func_spec.name}(#{args})"
+    end
+
+    # The expression calling the wrapped function of the given function of the
+    # sequence of the class directly from a const member of its range, or nil
+    # if this cannot be done. See +sequence_call+.
+    def sequence_inline_expression(func_spec)
+      return nil unless @spec.pointer_wrapper? || const_member?(func_spec)
+
+      self.class.new(func_spec).inline_call_expression
+    end
+
+    # True if the functions of the sequence of the class are called directly
+    # from the declaration of its range, instead of through the class.
+    def sequence_inlined?
+      [@spec.sequence.count, @spec.sequence.item].any? do |func_spec|
+        sequence_inline_expression(func_spec)
+      end
+    end
+
+    # The namespace that support files for this wrapper are generated in. This
+    # is the name of the scope that the spec belongs to.
+    def support_namespace
+      @spec.is_a?(Scope) ? @spec.name : @spec.scope.name
+    end
+
+    # The template head declaring the type parameter of the given class.
+    def template_head(class_spec)
+      "template<typename #{class_spec.template_parameter}>"
+    end
+
     # Gives a code snippet that accesses the equivalent struct from within the
     # class using the 'this' keyword.
     # Expected to be called while @spec is a FunctionSpec.
@@ -811,7 +2441,53 @@ module Wrapture
     # within the class using the 'this' keyword.
     # Expected to be called while @spec is a FunctionSpec.
     def this_struct_pointer
-      "#{'&' unless @spec.owner.pointer_wrapper?}this->equivalent"
+      return 'this->equivalent' if @spec.owner.pointer_wrapper?
+      return '&this->equivalent' unless const_member?(@spec)
+
+      # the wrapped function may not take a pointer to a const struct
+      pointer_type = @spec.owner.struct.pointer_declaration('')
+      "const_cast<#{pointer_type}>( &this->equivalent )"
+    end
+
+    # A list of pairs describing what a declaration using the given TypeSpec
+    # needs in order to compile. Each pair is one of:
+    # [:struct, name]:: a forward declaration of the struct +name+
+    # [:class, name]:: a forward declaration of the class +name+ of the scope
+    # [:include, file]:: an include of the header +file+ of a scope class
+    # [:library]:: the headers of the wrapped library
+    #
+    # Types built into the language need nothing, and are left out.
+    def type_requirements(type)
+      if type.function?
+        func = type.function
+        types = func.params.map(&:type) << func.return_type
+        return types.flat_map { |func_type| type_requirements(func_type) }
+      end
+
+      owned = type.name[/\Astd::unique_ptr<(.+)>\z/, 1]
+      return type_requirements(TypeSpec.new("#{owned} *")) if owned
+
+      words = type.base.split
+      return [] if type.variadic? || (words - BUILTIN_TYPE_WORDS).empty?
+
+      words -= %w[const volatile]
+
+      indirect = type.name.end_with?('*', '&')
+      if words.length == 2 && words.first == 'struct'
+        return [indirect ? [:struct, words.last] : [:library]]
+      end
+
+      class_spec = @spec.type(words.join(' '))
+      if class_spec.nil?
+        [[:library]]
+      elsif class_spec.equal?(@spec)
+        []
+      elsif indirect && class_spec.namespace == @spec.namespace &&
+            !class_spec.class_template
+        [[:class, class_spec.name]]
+      else
+        [[:include, self.class.declaration_filename(class_spec)]]
+      end
     end
 
     # A string with a declaration of a variable named +var_name+ of this type.
@@ -831,11 +2507,18 @@ module Wrapture
       end
     end
 
+    # True if any function of the class returns a std::unique_ptr.
+    def unique_ptr_returned?
+      class_functions.any? { |func| func.return_ownership == 'unique_ptr' }
+    end
+
     # The expression containing the call to the underlying wrapped function.
     def wrapped_call_expression
       call = @spec.wrapped.call_from(self)
 
-      if @spec.constructor?
+      if @spec.constructor? && @spec.in_place?
+        @spec.capture_return? ? "return_val = #{call}" : call
+      elsif @spec.constructor?
         "this->equivalent = #{call}"
       elsif @spec.wrapped.error_check?
         "return_val = #{call}"
@@ -845,5 +2528,16 @@ module Wrapture
         call
       end
     end
+
+    # The fully qualified name of the worker pool class used by asynchronous
+    # functions.
+    def worker_pool_class
+      "#{worker_pool_namespace}::WorkerPool"
+    end
+
+    # The fully qualified namespace of the worker pool support file.
+    def worker_pool_namespace
+      "::#{support_namespace}"
+    end
   end
 end
@@ -26,6 +26,10 @@ module Wrapture
   class FunctionSpec
     include Named
 
+    # The ways a function can give ownership of a returned class instance to
+    # its caller.
+    RETURN_OWNERSHIPS = %w[raw unique_ptr value].freeze
+
     # Returns a copy of the return type specification +spec+.
     def self.normalize_return_hash(spec)
       if spec.nil?
@@ -37,6 +41,7 @@ module Wrapture
         normalized['includes'] = Wrapture.normalize_array(spec['includes'])
         normalized['libraries'] = Wrapture.normalize_array(spec['libraries'])
         Wrapture.normalize_boolean!(spec, 'overloaded')
+        validate_return_ownership(normalized) if normalized.key?('ownership')
         normalized
       end
     end
@@ -57,10 +62,13 @@ module Wrapture
       Comment.validate_doc(spec['doc']) if spec.key?('doc')
 
       spec['version'] = Wrapture.spec_version(spec)
+      Wrapture.normalize_boolean!(spec, 'async')
       Wrapture.normalize_boolean!(spec, 'static')
       Wrapture.normalize_boolean!(spec, 'virtual')
       spec['params'] = ParamSpec.normalize_param_list(spec['params'])
       spec['return'] = normalize_return_hash(spec['return'])
+      normalize_side_effects!(spec)
+      normalize_ufunc!(spec)
 
       spec['initializers'] = [] unless spec.key?('initializers')
       if spec['initializers'].any? { |i| !i.key?('name') && !i['delegate'] }
@@ -72,6 +80,85 @@ module Wrapture
       spec
     end
 
+    # Normalizes the keys describing the side effects of a function spec in
+    # place. Each of const, pure, and side-effect-free implies the ones after
+    # it, and none of them may be given for a function without a return value.
+    #
+    # A const function may not read any memory, so only static functions that
+    # take no pointers or references may be const.
+    def self.normalize_side_effects!(spec)
+      Wrapture.normalize_boolean!(spec, 'const')
+      Wrapture.normalize_boolean!(spec, 'pure')
+      Wrapture.normalize_boolean!(spec, 'side-effect-free')
+      validate_const!(spec) if spec['const']
+      spec['pure'] ||= spec['const']
+      spec['side-effect-free'] ||= spec['pure']
+
+      return_type = spec['return']['type']
+      return unless spec['side-effect-free'] &&
+                    %w[void self-reference].include?(return_type)
+
+      raise InvalidSpecKey, 'a function without side effects must return a ' \
+                            'value other than a self-reference'
+    end
+    private_class_method :normalize_side_effects!
+
+    # Normalizes the ufunc flag of a function spec in place, defaulting it to
+    # false. Only static functions wrapping a function without an error check
+    # and returning a value may be ufuncs.
+    def self.normalize_ufunc!(spec)
+      Wrapture.normalize_boolean!(spec, 'ufunc')
+      return unless spec['ufunc']
+
+      wrapped = spec['wrapped-function']
+      return if spec['static'] && wrapped && !wrapped.key?('error-check') &&
+                !%w[void self-reference].include?(spec['return']['type'])
+
+      raise InvalidSpecKey, 'only static functions returning a value from a ' \
+                            'wrapped function without an error check may be ' \
+                            'ufuncs'
+    end
+    private_class_method :normalize_ufunc!
+
+    # Raises an InvalidSpecKey if the const function in the given spec may read
+    # memory, either through the instance it is called on or a parameter.
+    def self.validate_const!(spec)
+      indirect = spec['params'].any? do |param|
+        type = param['type'].to_s
+        type.include?('*') || type.include?('&') ||
+          [EQUIVALENT_POINTER_KEYWORD, SELF_REFERENCE_KEYWORD].include?(type)
+      end
+      return if spec['static'] && !indirect
+
+      raise InvalidSpecKey, "#{spec['name']} cannot be const, as only static " \
+                            'functions without pointer or reference ' \
+                            'parameters are guaranteed not to read memory ' \
+                            '(consider pure instead)'
+    end
+    private_class_method :validate_const!
+
+    # Raises an InvalidSpecKey if the ownership of the normalized return spec
+    # +spec+ is not valid.
+    def self.validate_return_ownership(spec)
+      ownership = spec['ownership']
+      unless RETURN_OWNERSHIPS.include?(ownership)
+        raise InvalidSpecKey.new("#{ownership} is not a valid return ownership",
+                                 valid_keys: RETURN_OWNERSHIPS)
+      end
+
+      return if ownership == 'raw'
+
+      unless spec['type'].is_a?(String) && spec['type'].end_with?('*')
+        raise InvalidSpecKey, 'return ownership can only be given for a ' \
+                              'pointer to a class'
+      end
+
+      return unless ownership == 'value' && spec['overloaded']
+
+      raise InvalidSpecKey, 'an overloaded return cannot be owned by value, ' \
+                            'as it would lose the type of the child class'
+    end
+
     # Creates a function spec based on the provided function spec.
     #
     # The hash must have a 'name' key with the name of the function in
@@ -102,10 +189,25 @@ module Wrapture
     # return value.
     #
     # The following keys are optional:
+    # async:: set to true to also generate variants of this function that run
+    #         it on a worker pool and deliver the result asynchronously
+    # const:: set to true if the result of this function depends only on the
+    #         values of its parameters, as with the const attribute of GCC.
+    #         Only static functions without pointer or reference parameters
+    #         may be const.
     # params:: a list of parameter specifications
     # doc:: a string containing the documentation for this function
+    # pure:: set to true if this function has no side effects and its result
+    #        depends only on its parameters and the memory that they point
+    #        to, as with the pure attribute of GCC
     # return:: a specification of the return value for this function
+    # side-effect-free:: set to true if calling this function changes nothing,
+    #                    so that it may be a const member function
     # static:: set to true if this is a static function
+    # ufunc:: set to true to also register this function as a NumPy ufunc in
+    #         Python modules built where NumPy is available, so that it can
+    #         be called over whole arrays. The function must be static, and
+    #         take and return only numeric types.
     # virtual:: set to true if this is a virtual function
     # initializers:: a list of member initializers
     #
@@ -126,6 +228,15 @@ module Wrapture
     # return value itself. If neither of these is needed, then the return
     # specification may simply be omitted.
     #
+    # If the return type is a pointer to a class, the return specification may
+    # also have an 'ownership' key with one of the following values to choose
+    # how the new instance is given to the caller:
+    # raw:: a pointer created with new, which the caller must delete (default)
+    # unique_ptr:: a std::unique_ptr holding the new instance
+    # value:: the instance itself, which cannot be used for overloaded returns
+    #         and is only available for classes that wrap a struct by value
+    #         or have shared ownership
+    #
     # The 'type' key of the return spec may also be set to 'self-reference'
     # which will have the function return a reference to the instance it was
     # called on. Of course, this cannot be used from a function that is not a
@@ -164,9 +275,23 @@ module Wrapture
     # A WrappedFunctionSpec or WrappedCodeSpec this .
     attr_reader :wrapped
 
-    # True if the return value of the wrapped call is saved.
+    # True if asynchronous variants of this function should be generated.
+    # Constructors and destructors never have asynchronous variants.
+    def async?
+      @spec['async'] && !@constructor && !@destructor
+    end
+
+    # True if the return value of the wrapped call is saved. Constructors only
+    # save it if they initialize their struct in place.
     def capture_return?
-      !@constructor && (@wrapped.use_return? || returns_return_val?)
+      (!@constructor || in_place?) &&
+        (@wrapped.use_return? || returns_return_val?)
+    end
+
+    # True if the result of the function depends only on the values of its
+    # parameters, without reading any memory that they point to.
+    def const?
+      @spec['const']
     end
 
     # True if the function is a constructor, false otherwise.
@@ -176,9 +301,8 @@ module Wrapture
 
     # A list of includes needed for the declaration of the function.
     def declaration_includes
-      includes = @spec['return']['includes'].dup
+      includes = return_includes
       @params.each { |param| includes.concat(param.includes) }
-      includes.concat(@return_type.includes)
       includes.uniq
     end
 
@@ -202,9 +326,8 @@ module Wrapture
     # A list of includes needed for the definition of the function.
     def definition_includes
       includes = @wrapped.includes
-      includes.concat(@spec['return']['includes'])
+      includes.concat(return_includes)
       @params.each { |param| includes.concat(param.includes) }
-      includes.concat(@return_type.includes)
       includes << 'stdarg.h' if variadic?
       includes.uniq
     end
@@ -230,6 +353,14 @@ module Wrapture
       Comment.new(comment)
     end
 
+    # True if this is a constructor that initializes the equivalent struct of
+    # its class in place, which it gives to the wrapped function as a pointer
+    # instead of taking the struct from its return value.
+    def in_place?
+      @constructor && @wrapped.is_a?(WrappedFunctionSpec) &&
+        @wrapped.param_value?(EQUIVALENT_POINTER_KEYWORD)
+    end
+
     # A list of initializer specs.
     def initializers
       @spec['initializers']
@@ -269,6 +400,12 @@ module Wrapture
       !@params.empty?
     end
 
+    # True if the function has no side effects and its result depends only on
+    # its parameters and the memory that they point to.
+    def pure?
+      @spec['pure']
+    end
+
     # The parameters that are required (no default values) for this function.
     def required_params
       @params.reject(&:default_value?)
@@ -289,9 +426,20 @@ module Wrapture
       end
     end
 
-    # The resolved type of the return type.
+    # The resolved type of the return type. This is the owning type given by
+    # the return ownership if there is one.
     def resolved_return
-      @return_type.resolve(self)
+      resolved = @return_type.resolve(self)
+
+      case return_ownership
+      when 'unique_ptr'
+        TypeSpec.new("std::unique_ptr<#{resolved.base}>")
+      when 'value'
+        validate_value_return(resolved)
+        TypeSpec.new(resolved.base)
+      else
+        resolved
+      end
     end
 
     # Calls return_expression on the return type of this function. +func_name+
@@ -304,6 +452,19 @@ module Wrapture
       end
     end
 
+    # A list of includes needed for the return type of the function.
+    def return_includes
+      includes = @spec['return']['includes'].dup
+      includes.concat(@return_type.includes)
+      includes.uniq
+    end
+
+    # How ownership of a returned class instance is given to the caller, one
+    # of RETURN_OWNERSHIPS.
+    def return_ownership
+      @spec['return'].fetch('ownership', 'raw')
+    end
+
     # True if the return type of this function is overloaded.
     def return_overloaded?
       @spec['return']['overloaded']
@@ -318,11 +479,22 @@ module Wrapture
         !@wrapped.error_check?
     end
 
+    # True if calling the function changes nothing, so that only its result
+    # is of any use.
+    def side_effect_free?
+      @spec['side-effect-free']
+    end
+
     # True if the function is static.
     def static?
       @spec['static']
     end
 
+    # True if the function is also registered as a NumPy ufunc.
+    def ufunc?
+      @spec['ufunc']
+    end
+
     # True if the function is variadic.
     def variadic?
       @params.last&.variadic?
@@ -346,5 +518,22 @@ module Wrapture
         @spec['return']['type'] != 'void' &&
         !returns_call_directly?
     end
+
+    # Raises an InvalidSpecKey unless the class of the given return type can
+    # be returned by value. The copies of a class wrapping a struct pointer
+    # share the pointer, so this is only allowed if it has shared ownership
+    # or wraps the struct itself, and a class overloaded by others would lose
+    # the type of the child class.
+    def validate_value_return(type)
+      class_spec = @owner.type(type)
+      copyable = class_spec &&
+                 (!class_spec.pointer_wrapper? || class_spec.shared?)
+      return if copyable && !class_spec.factory?
+
+      raise InvalidSpecKey, "#{name} cannot return #{type.base} by value, as " \
+                            'only classes that are not overloaded and wrap a ' \
+                            'struct by value or have shared ownership can be ' \
+                            'copied safely'
+    end
   end
 end
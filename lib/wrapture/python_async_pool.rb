@@ -0,0 +1,329 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # Generates the thread pool that the awaitable methods of a Python extension
+  # run their wrapped calls on.
+  #
+  # Each awaitable method submits a job to the pool holding its parsed
+  # arguments and an asyncio future. A thread of the pool runs the call of the
+  # job without holding the GIL, then takes the GIL to convert the result and
+  # hands it to the event loop of the future with +call_soon_threadsafe+.
+  #
+  # The threads are started on first use, and are stopped by an +atexit+
+  # handler so that none of them are running when the interpreter finalizes.
+  class PythonAsyncPool
+    # Creates a pool generator for the module with the given name.
+    def initialize(module_name)
+      @module_name = module_name
+    end
+
+    # Gives each line of the declarations and functions of the pool to the
+    # provided block.
+    def define(&block)
+      thread_count = "#{@module_name.upcase}_ASYNC_THREAD_COUNT"
+
+      <<~POOLTEXT.each_line(chomp: true, &block)
+        #ifndef #{thread_count}
+          #define #{thread_count} 4
+        #endif
+
+        typedef struct async_job {
+          struct async_job *next;
+          void ( *run )( struct async_job *job );
+          PyObject * ( *result )( struct async_job *job );
+          PyObject *owner;
+          PyObject *args;
+          PyObject *loop;
+          PyObject *future;
+        } async_job;
+
+        static struct {
+          pthread_mutex_t mutex;
+          pthread_cond_t ready;
+          pthread_t threads[#{thread_count}];
+          size_t thread_count;
+          async_job *head;
+          async_job *tail;
+          int stopping;
+        } async_pool = {
+          .mutex = PTHREAD_MUTEX_INITIALIZER,
+          .ready = PTHREAD_COND_INITIALIZER
+        };
+
+        static PyObject *async_get_running_loop = NULL;
+        static PyObject *async_complete_function = NULL;
+
+        static void
+        async_job_release( async_job *job ) {
+          Py_XDECREF( job->owner );
+          Py_XDECREF( job->args );
+          Py_XDECREF( job->loop );
+          Py_XDECREF( job->future );
+          free( job );
+        }
+
+        static PyObject *
+        async_complete( PyObject *Py_UNUSED( module ), PyObject *args ) {
+          PyObject *future;
+          PyObject *value;
+          PyObject *cancelled;
+          PyObject *outcome;
+          int is_error;
+
+          if( !PyArg_ParseTuple( args, "OOp", &future, &value, &is_error ) ){
+            return NULL;
+          }
+
+          cancelled = PyObject_CallMethod( future, "cancelled", NULL );
+          if( !cancelled ){
+            return NULL;
+          }
+
+          if( PyObject_IsTrue( cancelled ) ){
+            Py_DECREF( cancelled );
+            Py_RETURN_NONE;
+          }
+          Py_DECREF( cancelled );
+
+          outcome = PyObject_CallMethod( future,
+                                         is_error ? "set_exception"
+                                                  : "set_result",
+                                         "O",
+                                         value );
+          if( !outcome ){
+            return NULL;
+          }
+
+          Py_DECREF( outcome );
+          Py_RETURN_NONE;
+        }
+
+        static PyMethodDef async_complete_def = {
+          .ml_name = "_async_complete",
+          .ml_meth = ( PyCFunction ) async_complete,
+          .ml_flags = METH_VARARGS,
+          .ml_doc = NULL
+        };
+
+        static void
+        async_job_complete( async_job *job ) {
+          PyGILState_STATE gil_state;
+          PyObject *result;
+          PyObject *error_type;
+          PyObject *error_value;
+          PyObject *error_traceback;
+          PyObject *scheduled;
+
+          gil_state = PyGILState_Ensure();
+
+          result = job->result( job );
+          if( result ){
+            scheduled = PyObject_CallMethod( job->loop,
+                                             "call_soon_threadsafe",
+                                             "OOOO",
+                                             async_complete_function,
+                                             job->future,
+                                             result,
+                                             Py_False );
+            Py_DECREF( result );
+          } else {
+            PyErr_Fetch( &error_type, &error_value, &error_traceback );
+            PyErr_NormalizeException( &error_type,
+                                      &error_value,
+                                      &error_traceback );
+            if( !error_value ){
+              Py_INCREF( Py_None );
+              error_value = Py_None;
+            }
+            scheduled = PyObject_CallMethod( job->loop,
+                                             "call_soon_threadsafe",
+                                             "OOOO",
+                                             async_complete_function,
+                                             job->future,
+                                             error_value,
+                                             Py_True );
+            Py_XDECREF( error_type );
+            Py_XDECREF( error_value );
+            Py_XDECREF( error_traceback );
+          }
+
+          // the loop has been closed, so nobody is waiting on the future
+          if( !scheduled ){
+            PyErr_Clear();
+          }
+          Py_XDECREF( scheduled );
+
+          async_job_release( job );
+          PyGILState_Release( gil_state );
+        }
+
+        static void *
+        async_pool_work( void *Py_UNUSED( arg ) ) {
+          async_job *job;
+
+          for( ;; ) {
+            pthread_mutex_lock( &async_pool.mutex );
+            while( !async_pool.head && !async_pool.stopping ) {
+              pthread_cond_wait( &async_pool.ready, &async_pool.mutex );
+            }
+
+            job = async_pool.head;
+            if( !job ){
+              pthread_mutex_unlock( &async_pool.mutex );
+              return NULL;
+            }
+
+            async_pool.head = job->next;
+            if( !async_pool.head ){
+              async_pool.tail = NULL;
+            }
+            pthread_mutex_unlock( &async_pool.mutex );
+
+            job->run( job );
+            async_job_complete( job );
+          }
+        }
+
+        static PyObject *
+        async_pool_submit( async_job *job ) {
+          int failed = 0;
+
+          pthread_mutex_lock( &async_pool.mutex );
+          while( !async_pool.stopping &&
+                 async_pool.thread_count < #{thread_count} ) {
+            pthread_t *thread = &async_pool.threads[async_pool.thread_count];
+            if( pthread_create( thread, NULL, async_pool_work, NULL ) != 0 ){
+              break;
+            }
+            async_pool.thread_count++;
+          }
+
+          if( async_pool.stopping || async_pool.thread_count == 0 ){
+            failed = 1;
+          } else {
+            job->next = NULL;
+            if( async_pool.tail ){
+              async_pool.tail->next = job;
+            } else {
+              async_pool.head = job;
+            }
+            async_pool.tail = job;
+            pthread_cond_signal( &async_pool.ready );
+          }
+          pthread_mutex_unlock( &async_pool.mutex );
+
+          if( failed ){
+            async_job_release( job );
+            PyErr_SetString( PyExc_RuntimeError,
+                             "the async thread pool is not available" );
+            return NULL;
+          }
+
+          Py_INCREF( job->future );
+          return job->future;
+        }
+
+        static PyObject *
+        async_pool_shutdown( PyObject *Py_UNUSED( module ),
+                             PyObject *Py_UNUSED( ignored ) ) {
+          size_t i;
+
+          pthread_mutex_lock( &async_pool.mutex );
+          async_pool.stopping = 1;
+          pthread_cond_broadcast( &async_pool.ready );
+          pthread_mutex_unlock( &async_pool.mutex );
+
+          // the threads need the GIL to finish the jobs left in the queue
+          Py_BEGIN_ALLOW_THREADS
+          for( i = 0; i < async_pool.thread_count; i++ ) {
+            pthread_join( async_pool.threads[i], NULL );
+          }
+          Py_END_ALLOW_THREADS
+
+          async_pool.thread_count = 0;
+          Py_RETURN_NONE;
+        }
+
+        static PyMethodDef async_pool_shutdown_def = {
+          .ml_name = "_async_pool_shutdown",
+          .ml_meth = ( PyCFunction ) async_pool_shutdown,
+          .ml_flags = METH_NOARGS,
+          .ml_doc = NULL
+        };
+
+        static int
+        async_pool_init( void ) {
+          PyObject *asyncio_mod;
+          PyObject *atexit_mod;
+          PyObject *shutdown_function;
+          PyObject *registered;
+
+          // the pool is shared by every module object created from the module
+          if( async_complete_function ){
+            return 0;
+          }
+
+          asyncio_mod = PyImport_ImportModule( "asyncio" );
+          if( !asyncio_mod ){
+            return -1;
+          }
+
+          async_get_running_loop = PyObject_GetAttrString( asyncio_mod,
+                                                           "get_running_loop" );
+          Py_DECREF( asyncio_mod );
+          if( !async_get_running_loop ){
+            return -1;
+          }
+
+          async_complete_function = PyCFunction_New( &async_complete_def,
+                                                     NULL );
+          if( !async_complete_function ){
+            return -1;
+          }
+
+          atexit_mod = PyImport_ImportModule( "atexit" );
+          if( !atexit_mod ){
+            return -1;
+          }
+
+          shutdown_function = PyCFunction_New( &async_pool_shutdown_def, NULL );
+          if( !shutdown_function ){
+            Py_DECREF( atexit_mod );
+            return -1;
+          }
+
+          registered = PyObject_CallMethod( atexit_mod,
+                                            "register",
+                                            "O",
+                                            shutdown_function );
+          Py_DECREF( shutdown_function );
+          Py_DECREF( atexit_mod );
+          if( !registered ){
+            return -1;
+          }
+
+          Py_DECREF( registered );
+          return 0;
+        }
+      POOLTEXT
+    end
+  end
+end
@@ -21,27 +21,6 @@
 module Wrapture
   # A wrapper that generates Python wrappers for given specs.
   class PythonWrapper
-    # Mapping of basic types to their Py_T counterparts.
-    MEMBER_TYPE_MAP = {
-      'byte' => 'Py_T_BYTE',
-      'char' => 'Py_T_CHAR',
-      'short' => 'Py_T_SHORT',
-      'int' => 'Py_T_INT',
-      'long' => 'Py_T_LONG',
-      'long long' => 'Py_T_LONGLONG',
-      'unsigned char' => 'Py_T_UBYTE',
-      'unsigned short' => 'Py_T_USHORT',
-      'unsigned int' => 'Py_T_UINT',
-      'unsigned long' => 'Py_T_ULONG',
-      'unsigned long long' => 'Py_T_ULONGLONG',
-      'size_t' => 'Py_T_PYSSIZET',
-      'float' => 'Py_T_FLOAT',
-      'double' => 'Py_T_DOUBLE',
-      'bool' => 'Py_T_BOOL',
-      # no current wrapture construct for Py_T_STRING_INPLACE
-      'string' => 'Py_T_STRING'
-    }.freeze
-
     # Mapping of types to their PyArg_ParseTuple format string.
     TYPE_FORMAT_UNIT_MAP = {
       'byte' => 'b',
@@ -49,21 +28,87 @@ module Wrapture
       'short' => 'h',
       'int' => 'i',
       'long' => 'l',
-      'long long' => 'k',
+      'long long' => 'L',
       'unsigned char' => 'B',
       'unsigned short' => 'H',
       'unsigned int' => 'I',
-      'unsigned long' => 'L',
+      'unsigned long' => 'k',
       'unsigned long long' => 'K',
       'size_t' => 'n',
+      'ssize_t' => 'n',
       'float' => 'f',
       'double' => 'd',
       'bool' => 'p',
       'const char *' => 's',
-      'string' => 's'
+      'string' => 's',
+      'void *' => 'O'
+    }.freeze
+
+    # Mapping of the numeric types that NumPy ufuncs may take and return to
+    # their NumPy type numbers.
+    NUMPY_TYPE_MAP = {
+      'bool' => 'NPY_BOOL',
+      'signed char' => 'NPY_BYTE',
+      'unsigned char' => 'NPY_UBYTE',
+      'short' => 'NPY_SHORT',
+      'unsigned short' => 'NPY_USHORT',
+      'int' => 'NPY_INT',
+      'unsigned int' => 'NPY_UINT',
+      'long' => 'NPY_LONG',
+      'unsigned long' => 'NPY_ULONG',
+      'long long' => 'NPY_LONGLONG',
+      'unsigned long long' => 'NPY_ULONGLONG',
+      'size_t' => 'NPY_UINTP',
+      'ssize_t' => 'NPY_INTP',
+      'int8_t' => 'NPY_INT8',
+      'int16_t' => 'NPY_INT16',
+      'int32_t' => 'NPY_INT32',
+      'int64_t' => 'NPY_INT64',
+      'uint8_t' => 'NPY_UINT8',
+      'uint16_t' => 'NPY_UINT16',
+      'uint32_t' => 'NPY_UINT32',
+      'uint64_t' => 'NPY_UINT64',
+      'float' => 'NPY_FLOAT',
+      'double' => 'NPY_DOUBLE',
+      'long double' => 'NPY_LONGDOUBLE'
     }.freeze
 
-    # Gives the name of the type object instance for a given class.
+    # Mapping of the integer types of stdint.h to the prefix of the macros
+    # giving their limits. Types as wide as a long long map to nil, as they
+    # need no check beyond the one made when converting a Python integer.
+    STDINT_LIMIT_MAP = {
+      'int8_t' => 'INT8',
+      'int16_t' => 'INT16',
+      'int32_t' => 'INT32',
+      'int64_t' => nil,
+      'int_least8_t' => 'INT_LEAST8',
+      'int_least16_t' => 'INT_LEAST16',
+      'int_least32_t' => 'INT_LEAST32',
+      'int_least64_t' => nil,
+      'int_fast8_t' => 'INT_FAST8',
+      'int_fast16_t' => 'INT_FAST16',
+      'int_fast32_t' => 'INT_FAST32',
+      'int_fast64_t' => nil,
+      'intptr_t' => 'INTPTR',
+      'intmax_t' => nil,
+      'uint8_t' => 'UINT8',
+      'uint16_t' => 'UINT16',
+      'uint32_t' => 'UINT32',
+      'uint64_t' => nil,
+      'uint_least8_t' => 'UINT_LEAST8',
+      'uint_least16_t' => 'UINT_LEAST16',
+      'uint_least32_t' => 'UINT_LEAST32',
+      'uint_least64_t' => nil,
+      'uint_fast8_t' => 'UINT_FAST8',
+      'uint_fast16_t' => 'UINT_FAST16',
+      'uint_fast32_t' => 'UINT_FAST32',
+      'uint_fast64_t' => nil,
+      'uintptr_t' => 'UINTPTR',
+      'uintmax_t' => nil
+    }.freeze
+
+    # Gives the name of the field of the module state holding the type object
+    # for a given class.
     def self.type_object_name(class_spec)
       "#{class_spec.snake_case_name}_type_object"
     end
@@ -82,6 +127,15 @@ module Wrapture
       wrapper.write_setuptools_files(**kwargs)
     end
 
+    # Generates C source files that form a Python extension into the given
+    # sink, returning a list of the files generated. This is equivalent to
+    # instantiating a wrapper with the given spec, and then calling
+    # generate_source_files on that.
+    def self.generate_spec_source_files(spec, sink)
+      wrapper = new(spec)
+      wrapper.generate_source_files(sink)
+    end
+
     # Generates C source files that form a Python extension, returning a list
     # of the files generated. This is equivalent to instantiating a wrapper
     # with the given spec, and then calling write_source_files on that.
@@ -95,6 +149,13 @@ module Wrapture
       @spec = spec
     end
 
+    # True if any function in this wrapper's spec has an awaitable variant,
+    # which needs the async thread pool in the generated module.
+    def async?
+      @spec.is_a?(Scope) &&
+        @spec.classes.any? { |spec| spec.method_specs.any?(&:async?) }
+    end
+
     # Gives an expression for using a given parameter.
     # Equivalent structs and pointers are resolved, as well as casts between
     # types if they are known within the scope of this function.
@@ -117,84 +178,89 @@ module Wrapture
     end
 
     # Generates the setup.py script and other supporting files for this
-    # instance's spec. These can be used to package the files generated by
-    # +write_source_files+.
-    def write_setuptools_files(dir: Dir.pwd)
+    # instance's spec into the given sink, returning a list of the files
+    # generated. +sink+ may be a Sink or any target accepted by one.
+    def generate_setuptools_files(sink)
       unless @spec.is_a?(Scope)
         raise WrapError, 'only a scope can be used for setuptools generation'
       end
 
-      libraries = @spec.libraries.map { |lib| "'#{lib}'" }.join(', ')
+      [Sink.for(sink).write_file('setup.py') { |out| define_setup(&out) }]
+    end
 
-      File.open(File.join(dir, 'setup.py'), 'w') do |file|
-        file.puts <<~SETUPTEXT
-          from setuptools import setup, Extension
+    # Generates C source files that form an extension module of Python with
+    # the functionality of this instance's spec into the given sink, returning
+    # a list of the files generated. +sink+ may be a Sink or any target
+    # accepted by one, for example a Hash which will map each filename to its
+    # contents.
+    def generate_source_files(sink)
+      unless @spec.is_a?(Scope)
+        raise WrapError, 'only a scope can be used for module generation'
+      end
 
-          #{@spec.name}_mod = Extension('#{@spec.name}',
-                                        language = 'c',
-                                        sources = ['#{@spec.name}.c'],
-                                        libraries = [#{libraries}],
-                                        library_dirs = ['.'], # todo handle this
-                                        include_dirs = ['.']) # todo handle this
+      filename = "#{@spec.name}.c"
+      [Sink.for(sink).write_file(filename) { |out| define_module(&out) }]
+    end
 
-          setup(name = '#{@spec.name}',
-                version = '1.0', # todo create a scope version number
-                description = '#{@spec.doc.text}', # todo this should be better
-                ext_modules = [#{@spec.name}_mod])
-        SETUPTEXT
-      end
+    # Generates the setup.py script and other supporting files for this
+    # instance's spec. These can be used to package the files generated by
+    # +write_source_files+.
+    def write_setuptools_files(dir: Dir.pwd)
+      generate_setuptools_files(dir)
     end
 
     # Generates C source files that form an extension module of Python with
-    # the functionality of this instance's spec, returning a list of the
-    # files generated. +dir+ specifies the directory that the files should
+    # the functionality of this instance's spec, returning the name of the
+    # file generated. +dir+ specifies the directory that the files should
     # be written into. The default is the current working directory.
     def write_source_files(dir: Dir.pwd)
-      unless @spec.is_a?(Scope)
-        raise WrapError, 'only a scope can be used for module generation'
-      end
+      generate_source_files(dir).first
+    end
 
-      filename = "#{@spec.name}.c"
+    private
 
-      File.open(File.join(dir, filename), 'w') do |file|
-        define_module { |line| file.puts(line) }
+    # A list of the fields held by the job of an awaitable variant of the
+    # given function, as C declarations without a terminating semicolon. These
+    # are the parameters of the function and its return value.
+    def async_job_fields(func_spec)
+      fields = func_spec.params.map do |param_spec|
+        "#{param_local_type(func_spec, param_spec)} #{param_spec.name}"
       end
 
-      filename
+      unless func_spec.void_return?
+        fields << "#{return_val_type(func_spec)} return_val"
+      end
+
+      fields
     end
 
-    private
+    # The name of the awaitable variant of the given function as seen from
+    # Python.
+    def async_python_name(func_spec)
+      "#{func_spec.name}Async"
+    end
 
-    # Yields lines of C code to add the type object for the given class to this
-    # scope's module.
-    def add_class_type_object(class_spec, decref: [])
-      object_name = self.class.type_object_name(class_spec)
-      yield "Py_INCREF(&#{object_name});"
-      add_params = "m, \"#{class_spec.name}\", (PyObject *) &#{object_name}"
-      yield "if (PyModule_AddObject(#{add_params}) < 0) {"
-      decref.each { |obj| yield "  Py_DECREF( #{obj} );" }
-      yield '  return NULL;'
-      yield '}'
+    # The name of the C function wrapping the awaitable variant of the given
+    # function.
+    def async_wrapper_name(func_spec)
+      "#{function_wrapper_name(func_spec)}Async"
     end
 
-    # Passes lines of C code to the given block which adds type objects for
-    # all classes and enums in this module.
-    def add_scope_type_objects(&block)
-      previous_objects = ['m']
-      @spec.classes.each do |item|
-        object_name = "&#{self.class.type_object_name(item)}"
-        previous_objects << object_name
-        add_class_type_object(item, decref: previous_objects.reverse) do |line|
-          block.call(line)
+    # The functions of the given class that have awaitable variants. Raises a
+    # WrapError if one of these cannot be run on the async thread pool.
+    def async_functions(class_spec)
+      funcs = class_spec.method_specs
+      funcs.select(&:async?).each do |func_spec|
+        if funcs.count { |other| other.name == func_spec.name } > 1
+          raise WrapError, "overloaded function #{func_spec.name} cannot " \
+                           'have an awaitable Python variant'
         end
-        yield ''
-      end
 
-      @spec.enums.each do |enum_spec|
-        snake_name = enum_spec.snake_case_name
-        block.call("Py_DECREF( add_#{snake_name}_enum_to_module( m ) );")
+        if func_spec.return_type.self_reference? || func_spec.variadic?
+          raise WrapError, "#{func_spec.name} cannot be made awaitable, as " \
+                           'it returns a self-reference or is variadic'
+        end
       end
-      yield ''
     end
 
     # Returns a cast of an instance of this class with the provided name to the
@@ -219,6 +285,12 @@ module Wrapture
         @spec.owner.type?(param.type)
     end
 
+    # The name of the function adding the constants of the given class to its
+    # type object.
+    def class_constants_function_name(class_spec)
+      "#{class_spec.snake_case_name}_add_constants"
+    end
+
     # Returns a list of FunctionSpecs describing all of the functions generated
     # for a ClassSpec. This includes both those listed in the original
     # ClassSpec, as well as those auto-generated for Python.
@@ -256,14 +328,43 @@ module Wrapture
     end
 
     # Creates a Python object using a variable with the given name and type.
+    #
+    # A typemap of the scope for the type is used if it has a to-python
+    # function. The integer types of stdint.h are converted through the long
+    # long functions, which are wide enough to hold any of them. A WrapError
+    # is raised for any other type that cannot be converted.
     def create_python_object(type, name)
-      if type.name == 'int'
+      typemap = @spec.typemap(type)
+      return "#{typemap.to_python}(#{name})" if typemap&.to_python
+
+      if STDINT_LIMIT_MAP.key?(type.name)
+        unsigned = type.name.start_with?('u')
+        return "PyLong_From#{unsigned ? 'Unsigned' : ''}LongLong(#{name})"
+      end
+
+      case type.name
+      when 'byte', 'char', 'signed char', 'short', 'int', 'long'
         "PyLong_FromLong(#{name})"
-      elsif type.name == 'bool'
+      when 'long long'
+        "PyLong_FromLongLong(#{name})"
+      when 'unsigned char', 'unsigned short', 'unsigned int', 'unsigned long'
+        "PyLong_FromUnsignedLong(#{name})"
+      when 'unsigned long long'
+        "PyLong_FromUnsignedLongLong(#{name})"
+      when 'size_t'
+        "PyLong_FromSize_t(#{name})"
+      when 'ssize_t'
+        "PyLong_FromSsize_t(#{name})"
+      when 'float', 'double', 'long double'
+        "PyFloat_FromDouble(#{name})"
+      when 'bool'
         "PyBool_FromLong(#{name})"
+      when 'const char *', 'char *', 'string'
+        # a NULL string is often used for no value, so it is given as None
+        "#{name} ? PyUnicode_FromString(#{name}) : " \
+          '( Py_INCREF(Py_None), Py_None )'
       else
-        # TODO: default case
-        '// TODO default case'
+        raise WrapError, unsupported_type_message(type.name)
       end
     end
 
@@ -272,7 +373,8 @@ module Wrapture
     # A factory constructor creates an instance of a class based on a struct
     # that is overloaded.
     def declare_factory_constructor(class_spec)
-      param_decl = "struct #{class_spec.struct.name} *equivalent"
+      param_decl = "#{module_state_name} *state, " \
+                   "struct #{class_spec.struct.name} *equivalent"
       yield "PyObject * new_#{class_spec.name}( #{param_decl} );"
     end
 
@@ -292,23 +394,157 @@ module Wrapture
       FunctionSpec.new(spec_hash, class_spec, destructor: true)
     end
 
+    # Defines the awaitable variant of the given function, along with the job
+    # type that it submits to the async thread pool and the functions that the
+    # pool calls to run the job and convert its result.
+    #
+    # The job runs the same wrapped call as the synchronous function, but on
+    # a thread of the pool without holding the GIL. Its result is converted
+    # with the same return statement once the thread has taken the GIL.
+    def define_async_function_wrapper(func_spec, &block)
+      name = async_wrapper_name(func_spec)
+      owner_struct = type_struct_name(func_spec.owner)
+      job_type = "#{name}_job"
+      fields = async_job_fields(func_spec)
+
+      yield 'typedef struct {'
+      yield '  async_job base;'
+      fields.each { |field| yield "  #{field};" }
+      yield "} #{job_type};"
+      yield ''
+
+      yield 'static void'
+      yield "#{name}_run( async_job *base ) {"
+      yield "  #{job_type} *job = ( #{job_type} * ) base;" unless fields.empty?
+      unless func_spec.static?
+        yield "  #{owner_struct} *self = ( #{owner_struct} * ) base->owner;"
+      end
+      func_spec.param_names.zip(fields).each do |param_name, field|
+        yield "  #{field} = job->#{param_name};"
+      end
+      unless func_spec.void_return?
+        yield "  #{return_val_type(func_spec)} return_val;"
+      end
+      yield ''
+      wrapped_call(func_spec, &block)
+      yield '  job->return_val = return_val;' unless func_spec.void_return?
+      yield '}'
+      yield ''
+
+      yield 'static PyObject *'
+      if func_spec.void_return?
+        yield "#{name}_result( async_job *Py_UNUSED( base ) ) {"
+      else
+        yield "#{name}_result( async_job *base ) {"
+        yield "  #{return_val_type(func_spec)} return_val = " \
+              "( ( #{job_type} * ) base )->return_val;"
+        yield "  #{module_state_name} *state;" if state_needed?([func_spec])
+        yield ''
+      end
+      if state_needed?([func_spec])
+        state_lookup(state_type(func_spec, 'base->owner')) do |line|
+          yield "  #{line}"
+        end
+        yield ''
+      end
+      yield "  #{return_statement(func_spec)}"
+      yield '}'
+      yield ''
+
+      if func_spec.params?
+        define_function_arg_parser(func_spec, "parse_#{name}", &block)
+        yield ''
+      end
+
+      yield 'static PyObject *'
+      yield "#{name}( #{function_params(func_spec).join(', ')} ) {"
+      yield "  #{job_type} *job;"
+      yield '  PyObject *loop;'
+      function_param_locals(func_spec) { |line| yield "  #{line}" }
+      yield ''
+
+      if func_spec.params?
+        parsed_args = "&#{func_spec.param_names.join(', &')}"
+        yield "  if #{UNLIKELY_MACRO}( " \
+              "!parse_#{name}( args, NULL, #{parsed_args} ) ){"
+        yield '    return NULL;'
+        yield '  }'
+        yield ''
+      end
+
+      yield '  loop = PyObject_CallObject( async_get_running_loop, NULL );'
+      yield "  if #{UNLIKELY_MACRO}( !loop ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield "  job = ( #{job_type} * ) calloc( 1, sizeof( *job ) );"
+      yield "  if #{UNLIKELY_MACRO}( !job ){"
+      yield '    Py_DECREF( loop );'
+      yield '    return PyErr_NoMemory();'
+      yield '  }'
+      yield ''
+      yield "  job->base.run = #{name}_run;"
+      yield "  job->base.result = #{name}_result;"
+      yield '  job->base.loop = loop;'
+      yield '  job->base.future = ' \
+            'PyObject_CallMethod( loop, "create_future", NULL );'
+      yield "  if #{UNLIKELY_MACRO}( !job->base.future ){"
+      yield '    async_job_release( &job->base );'
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield '  job->base.owner = ( PyObject * ) self;'
+      yield '  Py_INCREF( self );'
+      if func_spec.params?
+        yield '  job->base.args = args;'
+        yield '  Py_INCREF( args );'
+      end
+      func_spec.param_names.each do |param_name|
+        yield "  job->#{param_name} = #{param_name};"
+      end
+      yield ''
+      yield '  return async_pool_submit( &job->base );'
+      yield '}'
+    end
+
+    # Passes lines of C code to the given block which define a function adding
+    # the constants of the given class to the dict of its type object.
+    #
+    # Constants are attributes of the type rather than of each instance, so
+    # they are created once when the module is initialized and are available
+    # from both the class and its instances. The function is given the type
+    # object once it has been created.
+    def define_class_constants(class_spec)
+      yield 'static int'
+      function_name = class_constants_function_name(class_spec)
+      yield "#{function_name}( PyTypeObject *type ) {"
+      yield '  PyObject *dict = type->tp_dict;'
+      yield '  PyObject *value;'
+
+      class_spec.constants.each do |constant_spec|
+        value = create_python_object(constant_spec.type, constant_spec.value)
+        yield ''
+        yield "  value = #{value};"
+        yield '  if( !value ||'
+        yield "      PyDict_SetItemString( dict, \"#{constant_spec.name}\", " \
+              'value ) < 0 ){'
+        yield '    Py_XDECREF( value );'
+        yield '    return -1;'
+        yield '  }'
+        yield '  Py_DECREF( value );'
+      end
+
+      yield ''
+      yield '  PyType_Modified( type );'
+      yield '  return 0;'
+      yield '}'
+    end
+
     # Passes lines of C code to the given block which define the members of the
     # given class as an array of PyMemberDef structures.
     def define_class_members(class_spec)
       snake_name = class_spec.snake_case_name
       yield "static PyMemberDef #{snake_name}_members[] = {"
-
-      class_spec.constants.each do |constant_spec|
-        yield "  { .name = \"#{constant_spec.name}\","
-        yield "    .type = #{member_type(constant_spec.type)},"
-
-        offset_struct = type_struct_name(class_spec)
-        offset_field = constant_spec.snake_case_name
-        yield "    .offset = offsetof( #{offset_struct}, #{offset_field} ),"
-        yield '    .flags = Py_READONLY,'
-        yield "    .doc = \"#{constant_spec.doc.text}\" },"
-      end
-
       yield '  {NULL}'
       yield '};'
     end
@@ -319,16 +555,39 @@ module Wrapture
       snake_name = class_spec.snake_case_name
       yield "static PyMethodDef #{snake_name}_methods[] = {"
 
-      # class_spec.functions.each do |func_spec|
-      # class_function_groups(class_spec).map(&:first).each do |func_spec|
-      class_spec.method_specs.each do |func_spec|
+      class_spec.method_specs.group_by(&:name).each_value do |func_group|
+        func_spec = func_group.first
         wrapper_name = function_wrapper_name(func_spec)
         yield "  { .ml_name = \"#{func_spec.name}\","
         yield "    .ml_meth = ( PyCFunction ) #{wrapper_name},"
-        yield "    .ml_flags = #{function_flags(func_spec)},"
+        yield "    .ml_flags = #{function_flags(func_group)},"
         yield "    .ml_doc = \"#{func_spec.doc.text}\" },"
       end
 
+      async_functions(class_spec).each do |func_spec|
+        yield "  { .ml_name = \"#{async_python_name(func_spec)}\","
+        yield "    .ml_meth = ( PyCFunction ) #{async_wrapper_name(func_spec)},"
+        yield "    .ml_flags = #{function_flags([func_spec])},"
+        yield "    .ml_doc = \"#{func_spec.doc.text}\" },"
+      end
+
+      if class_spec.sequence
+        yield '  { .ml_name = "to_list",'
+        yield "    .ml_meth = ( PyCFunction ) #{snake_name}_to_list,"
+        yield '    .ml_flags = METH_NOARGS,'
+        yield '    .ml_doc = "Returns a list of the items of this sequence." },'
+      end
+
+      if class_spec.serializable?
+        serialization_methods(class_spec).each do |method_name, flags, doc|
+          yield "  { .ml_name = \"#{method_name}\","
+          c_name = method_name.gsub(/\A_+|_+\z/, '')
+          yield "    .ml_meth = ( PyCFunction ) #{snake_name}_#{c_name},"
+          yield "    .ml_flags = #{flags},"
+          yield "    .ml_doc = \"#{doc}\" },"
+        end
+      end
+
       yield '  {NULL}'
       yield '};'
     end
@@ -348,6 +607,28 @@ module Wrapture
         yield ''
       end
 
+      async_functions(class_spec).each do |func_spec|
+        define_async_function_wrapper(func_spec, &block)
+        yield ''
+      end
+
+      if class_spec.sequence
+        define_sequence(class_spec, &block)
+        yield ''
+      end
+
+      if class_spec.serializable?
+        define_serialization(class_spec, &block)
+        yield ''
+      end
+
+      unless ufunc_functions(class_spec).empty?
+        yield "#ifdef #{NUMPY_MACRO}"
+        define_ufuncs(class_spec, &block)
+        yield '#endif'
+        yield ''
+      end
+
       # TODO: don't define these when not needed
       define_class_methods(class_spec, &block)
       yield ''
@@ -356,28 +637,49 @@ module Wrapture
       define_class_members(class_spec, &block)
       yield ''
 
-      snake_name = class_spec.snake_case_name
-      yield "static PyTypeObject #{self.class.type_object_name(class_spec)} = {"
-      yield '  PyVarObject_HEAD_INIT( NULL, 0 )'
-      yield "  .tp_name = \"#{@spec.name}.#{class_spec.name}\","
-      yield "  .tp_doc = \"#{class_spec.doc.text}\","
-      yield "  .tp_basicsize = sizeof( #{type_struct_name(class_spec)} ),"
-      yield '  .tp_itemsize = 0,'
-      yield '  .tp_flags = Py_TPFLAGS_DEFAULT,'
-      yield "  .tp_new = #{snake_name}_new,"
-      yield "  .tp_dealloc = ( destructor ) #{snake_name}_dealloc,"
-      yield "  .tp_methods = #{snake_name}_methods,"
+      define_class_type_spec(class_spec, &block)
+      yield ''
 
-      if class_spec.child?
-        parent = class_spec.parent_spec
-        unless parent.nil?
-          yield "  .tp_base = &#{self.class.type_object_name(parent)},"
-        end
-      end
+      return if class_spec.constants.empty?
+
+      define_class_constants(class_spec, &block)
+      yield ''
+    end
 
-      yield "  .tp_members = #{snake_name}_members"
+    # Yields lines of C code to define the slots and spec that the heap type
+    # of the given class is created from when the module is executed.
+    #
+    # Classes that are not final are given the base type flag, so that their
+    # children can be created from them.
+    def define_class_type_spec(class_spec)
+      snake_name = class_spec.snake_case_name
+      flags = ['Py_TPFLAGS_DEFAULT']
+      flags << 'Py_TPFLAGS_BASETYPE' unless class_spec.final?
+
+      yield "static PyType_Slot #{snake_name}_type_slots[] = {"
+      yield "  { Py_tp_doc, ( void * ) \"#{class_spec.doc.text}\" },"
+      yield "  { Py_tp_new, #{snake_name}_new },"
+      yield "  { Py_tp_dealloc, #{snake_name}_dealloc },"
+      yield "  { Py_tp_methods, #{snake_name}_methods },"
+      yield "  { Py_tp_members, #{snake_name}_members },"
+      if class_spec.sequence
+        yield "  { Py_sq_length, #{snake_name}_sq_length },"
+        yield "  { Py_sq_item, #{snake_name}_sq_item },"
+        yield "  { Py_tp_iter, #{snake_name}_iter },"
+      end
+      if class_spec.serializable?
+        yield "  { Py_bf_getbuffer, #{snake_name}_getbuffer },"
+      end
+      yield '  { 0, NULL }'
       yield '};'
       yield ''
+      yield "static PyType_Spec #{snake_name}_type_spec = {"
+      yield "  .name = \"#{@spec.name}.#{class_spec.name}\","
+      yield "  .basicsize = sizeof( #{type_struct_name(class_spec)} ),"
+      yield '  .itemsize = 0,'
+      yield "  .flags = #{flags.join(' | ')},"
+      yield "  .slots = #{snake_name}_type_slots"
+      yield '};'
     end
 
     # Yields lines of C code to define the struct used to wrap objects of the
@@ -393,9 +695,6 @@ module Wrapture
         yield '  PyObject_HEAD'
       end
 
-      class_spec.constants.each do |constant_spec|
-        yield "  #{constant_spec.type} #{constant_spec.snake_case_name};"
-      end
       if class_spec.equivalent_member?
         yield "  #{equivalent_member_declaration(class_spec)}"
       end
@@ -465,6 +764,33 @@ module Wrapture
       yield '}'
     end
 
+    # Yields lines of C code defining the macros and functions used on the
+    # error paths of the module.
+    #
+    # The unlikely macro marks the conditions that lead to errors so that the
+    # compiler lays out the code that handles them away from the normal path,
+    # and the cold attribute is used for out of line helpers that raise
+    # errors, keeping them out of the functions calling them.
+    def define_error_path_helpers
+      yield '#if defined( __GNUC__ )'
+      yield "  #define #{UNLIKELY_MACRO}( condition ) " \
+            '( __builtin_expect( !!( condition ), 0 ) )'
+      yield '  #define WRAPTURE_COLD __attribute__(( cold, noinline ))'
+      yield '#else'
+      yield "  #define #{UNLIKELY_MACRO}( condition ) ( condition )"
+      yield '  #define WRAPTURE_COLD'
+      yield '#endif'
+
+      return unless overloaded_functions?
+
+      yield ''
+      yield 'static WRAPTURE_COLD PyObject *'
+      yield 'raise_overload_mismatch( const char *message ) {'
+      yield '  PyErr_SetString( PyExc_TypeError, message );'
+      yield '  return NULL;'
+      yield '}'
+    end
+
     # Defines a function that parses and validates parameters of a function.
     def define_function_arg_parser(func_spec, name = nil)
       yield 'static int'
@@ -482,55 +808,55 @@ module Wrapture
       wrapped_args = signature_declarations.join(', ')
       yield "#{name}( PyObject *args, PyObject *kwds, #{wrapped_args} ) {"
       format_str = "\"#{function_args_format(func_spec)}\""
-      params = func_spec.param_names.join(', ')
+      params = func_spec.params.map do |param_spec|
+        converter = param_converter(func_spec, param_spec)
+        converter ? "#{converter}, #{param_spec.name}" : param_spec.name
+      end.join(', ')
       yield "  return PyArg_ParseTuple( args, #{format_str}, #{params} );"
       yield '}'
     end
 
     # Defines a function that determines which function in the provided group to
     # call based on the parameters, and then calls it in the python interpreter.
+    #
+    # The overload is chosen by first switching on the number of arguments, and
+    # then checking the type of each argument with the cheap Py*_Check family
+    # of functions, so that only the chosen overload parses and converts the
+    # arguments. Exact type matches are preferred over loose ones, for example
+    # an int argument will select an int overload over a double one regardless
+    # of declaration order. If no overload matches, a TypeError listing the
+    # valid signatures is raised.
     def define_function_group_wrapper(func_group, &block)
       base_name = function_wrapper_name(func_group[0])
-      no_args = nil
 
       func_group.each_with_index do |func_spec, i|
-        wrapper_name = "#{base_name}_#{i}"
-
-        no_args = wrapper_name unless func_spec.params?
-
-        define_function_wrapper(func_spec, wrapper_name, &block)
+        define_function_wrapper(func_spec, "#{base_name}_#{i}", &block)
         yield ''
       end
 
       yield 'static PyObject *'
-      yield "#{base_name}( #{function_params(func_group[0]).join(', ')} ) {"
-      yield '  int parse_result;'
-      func_group.each_with_index do |func_spec, i|
-        function_param_locals(func_spec, "_#{i}") do |stmt|
-          yield "  #{stmt}".rstrip
-        end
-      end
-      yield ''
-
-      func_group.each_with_index do |func_spec, i|
-        next unless func_spec.params?
-
-        wrapper_name = "#{base_name}_#{i}"
-        parser_name = "parse_#{base_name}_#{i}"
-        parsed_args = "&#{func_spec.param_names.join("_#{i}, &")}_#{i}"
-        yield "  parse_result = #{parser_name}( args, kwds, #{parsed_args} );"
-        yield '  if( parse_result ){'
-        yield "    return #{wrapper_name}( type, args, kwds );"
-        yield '  }'
+      group_params = function_params(func_group[0], varargs: true)
+      yield "#{base_name}( #{group_params.join(', ')} ) {"
+      if typed_overloads?(func_group)
+        yield "  #{module_state_name} *state;"
+        yield ''
+        state_lookup(state_type(func_group[0])) { |line| yield "  #{line}" }
         yield ''
       end
-
-      if no_args
-        yield '  // TODO check to make sure there are no args for this call'
-        yield "  return #{no_args}( type, args, kwds );"
+      yield '  switch( PyTuple_GET_SIZE( args ) ) {'
+      overload_arities(func_group).each do |arg_count, candidates|
+        yield "  case #{arg_count}:"
+        overload_dispatch(func_group, candidates, arg_count) do |line|
+          yield "    #{line}"
+        end
       end
+      yield '  }'
+      yield ''
 
-      yield '  // TODO throw an error for no overload found'
+      signatures = func_group.map { |func_spec| overload_signature(func_spec) }
+      no_match = "no overload of #{python_name(func_group[0])} matches the " \
+                 "given arguments (expected #{signatures.join(', ')})"
+      yield "  return raise_overload_mismatch( \"#{no_match}\" );"
       yield '}'
     end
 
@@ -546,8 +872,11 @@ module Wrapture
       if func_spec.destructor?
         yield 'static void'
         yield "#{name}( #{type_struct_name} *self ) {"
+        yield '  PyTypeObject *type = Py_TYPE( self );'
+        yield ''
         wrapped_call(func_spec, &block)
-        yield '  Py_TYPE( self )->tp_free( ( PyObject * ) self );'
+        yield '  type->tp_free( ( PyObject * ) self );'
+        yield '  Py_DECREF( type );'
       else
         if func_spec.params?
           define_function_arg_parser(func_spec, "parse_#{name}", &block)
@@ -560,25 +889,23 @@ module Wrapture
 
         if func_spec.params?
           parsed_args = "&#{func_spec.param_names.join(', &')}"
-          yield "  if( !parse_#{name}( args, NULL, #{parsed_args} ) ){"
+          yield "  if #{UNLIKELY_MACRO}( " \
+                "!parse_#{name}( args, NULL, #{parsed_args} ) ){"
           yield '    return NULL;'
           yield '  }'
           yield ''
         end
 
+        if state_needed?([func_spec])
+          state_lookup(state_type(func_spec)) { |line| yield "  #{line}" }
+          yield ''
+        end
+
         if func_spec.constructor?
           yield "  self = ( #{type_struct_name} * ) type->tp_alloc( type, 0 );"
-          yield '  if( !self ) {'
+          yield "  if #{UNLIKELY_MACRO}( !self ){"
           yield '    return NULL;'
           yield '  }'
-
-          yield '' unless func_spec.owner.constants.empty?
-
-          func_spec.owner.constants.each do |constant_spec|
-            field_name = constant_spec.snake_case_name
-            field_value = constant_spec.value
-            yield "  self->#{field_name} = #{field_value};"
-          end
           yield ''
         end
 
@@ -591,6 +918,189 @@ module Wrapture
       yield '}'
     end
 
+    # Yields lines of C code defining the functions that write and check the
+    # header written before the struct of a serializable class, which is the
+    # same as the one written by the C++ wrapper so that bytes may be passed
+    # between the two.
+    def define_layout_header_helpers
+      byte_order_error = 'the bytes were written with a different byte order'
+      layout_error = 'the bytes were written for a different struct layout'
+
+      <<~CTEXT.each_line(chomp: true) { |line| yield line }
+        static void
+        write_layout_header( unsigned char *header, uint64_t fingerprint,
+                             uint32_t struct_size ) {
+          const uint32_t byte_order = #{BYTE_ORDER_MARK};
+
+          memcpy( header, &byte_order, 4 );
+          memcpy( header + 4, &struct_size, 4 );
+          memcpy( header + 8, &fingerprint, 8 );
+        }
+
+        static int
+        check_layout_header( const unsigned char *header, uint64_t fingerprint,
+                             uint32_t struct_size ) {
+          uint32_t written_byte_order;
+          uint32_t written_struct_size;
+          uint64_t written_fingerprint;
+
+          memcpy( &written_byte_order, header, 4 );
+          memcpy( &written_struct_size, header + 4, 4 );
+          memcpy( &written_fingerprint, header + 8, 8 );
+
+          if #{UNLIKELY_MACRO}( written_byte_order != #{BYTE_ORDER_MARK} ) {
+            PyErr_SetString( PyExc_ValueError, "#{byte_order_error}" );
+            return -1;
+          }
+
+          if #{UNLIKELY_MACRO}( written_struct_size != struct_size ||
+                                 written_fingerprint != fingerprint ) {
+            PyErr_SetString( PyExc_ValueError, "#{layout_error}" );
+            return -1;
+          }
+
+          return 0;
+        }
+      CTEXT
+    end
+
+    # Yields lines of C code defining the functions that create the types of a
+    # module with lazy types, along with the module __getattr__ and __dir__
+    # functions described in PEP 562 that create them and the enums of the
+    # module when they are first used. A function setting the __all__ list of
+    # the module to the lazy names is also defined, so that star imports get
+    # them through __getattr__.
+    def define_lazy_types(&block)
+      name = @spec.name
+      lazy_names = @spec.classes.map(&:name) + @spec.enums.map(&:name)
+
+      @spec.classes.each do |class_spec|
+        function_name = type_ready_function_name(class_spec)
+        yield "static PyTypeObject * #{function_name}( " \
+              "PyObject *m, #{module_state_name} *state );"
+      end
+      yield '' unless @spec.classes.empty?
+
+      @spec.classes.each do |class_spec|
+        define_type_ready_function(class_spec, &block)
+        yield ''
+      end
+
+      yield 'static PyObject *'
+      yield "#{name}_module_getattr( PyObject *m, PyObject *attr ) {"
+      if module_state?
+        yield "  #{module_state_name} *state = " \
+              "( #{module_state_name} * ) PyModule_GetState( m );"
+      end
+      yield '  const char *attr_name = PyUnicode_AsUTF8( attr );'
+      yield ''
+      yield "  if #{UNLIKELY_MACRO}( !attr_name ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      line_prefix = ''
+      @spec.classes.each do |class_spec|
+        yield "  #{line_prefix}if( strcmp( attr_name, " \
+              "\"#{class_spec.name}\" ) == 0 ){"
+        yield "    if( !#{type_ready_function_name(class_spec)}( m, state ) ){"
+        yield '      return NULL;'
+        yield '    }'
+        line_prefix = '} else '
+      end
+      @spec.enums.each do |enum_spec|
+        yield "  #{line_prefix}if( strcmp( attr_name, " \
+              "\"#{enum_spec.name}\" ) == 0 ){"
+        yield "    if( !add_#{enum_spec.snake_case_name}_enum_to_module( m ) ){"
+        yield '      return NULL;'
+        yield '    }'
+        line_prefix = '} else '
+      end
+      yield "  #{line_prefix}{"
+      yield '    PyErr_Format( PyExc_AttributeError,'
+      yield "                  \"module '#{name}' has no attribute '%U'\","
+      yield '                  attr );'
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield '  return PyObject_GenericGetAttr( m, attr );'
+      yield '}'
+      yield ''
+      yield "static const char *#{name}_module_lazy_names[] = {"
+      lazy_names.each { |lazy_name| yield "  \"#{lazy_name}\"," }
+      yield '  NULL'
+      yield '};'
+      yield ''
+      yield 'static PyObject *'
+      yield "#{name}_module_dir( PyObject *m, PyObject *Py_UNUSED( args ) ) {"
+      yield '  PyObject *names = PySet_New( PyModule_GetDict( m ) );'
+      yield '  PyObject *lazy_name;'
+      yield '  PyObject *dir;'
+      yield ''
+      yield "  if #{UNLIKELY_MACRO}( !names ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield "  for( size_t i = 0; #{name}_module_lazy_names[i]; i++ ){"
+      yield '    lazy_name = PyUnicode_FromString( ' \
+            "#{name}_module_lazy_names[i] );"
+      yield "    if #{UNLIKELY_MACRO}( !lazy_name ||"
+      yield "                        PySet_Add( names, lazy_name ) < 0 ){"
+      yield '      Py_XDECREF( lazy_name );'
+      yield '      Py_DECREF( names );'
+      yield '      return NULL;'
+      yield '    }'
+      yield '    Py_DECREF( lazy_name );'
+      yield '  }'
+      yield ''
+      yield '  dir = PySequence_List( names );'
+      yield '  Py_DECREF( names );'
+      yield '  return dir;'
+      yield '}'
+      yield ''
+      yield 'static int'
+      yield "#{name}_module_set_all( PyObject *m ) {"
+      yield '  PyObject *all = PyList_New( 0 );'
+      yield '  PyObject *lazy_name;'
+      yield ''
+      yield "  if #{UNLIKELY_MACRO}( !all ){"
+      yield '    return -1;'
+      yield '  }'
+      yield ''
+      yield "  for( size_t i = 0; #{name}_module_lazy_names[i]; i++ ){"
+      yield '    lazy_name = PyUnicode_FromString( ' \
+            "#{name}_module_lazy_names[i] );"
+      yield "    if #{UNLIKELY_MACRO}( !lazy_name ||"
+      yield "                        PyList_Append( all, lazy_name ) < 0 ){"
+      yield '      Py_XDECREF( lazy_name );'
+      yield '      Py_DECREF( all );'
+      yield '      return -1;'
+      yield '    }'
+      yield '    Py_DECREF( lazy_name );'
+      yield '  }'
+      yield ''
+      yield '  if( PyModule_AddObject( m, "__all__", all ) < 0 ){'
+      yield '    Py_DECREF( all );'
+      yield '    return -1;'
+      yield '  }'
+      yield ''
+      yield '  return 0;'
+      yield '}'
+      yield ''
+      yield "static PyMethodDef #{name}_module_methods[] = {"
+      yield '  { .ml_name = "__getattr__",'
+      yield "    .ml_meth = ( PyCFunction ) #{name}_module_getattr,"
+      yield '    .ml_flags = METH_O,'
+      yield '    .ml_doc = "Creates the types and enums of the module when ' \
+            'they are first used." },'
+      yield '  { .ml_name = "__dir__",'
+      yield "    .ml_meth = ( PyCFunction ) #{name}_module_dir,"
+      yield '    .ml_flags = METH_NOARGS,'
+      yield '    .ml_doc = "Lists the attributes of the module, including ' \
+            'those not yet created." },'
+      yield '  {NULL}'
+      yield '};'
+    end
+
     # Yields the full contents of the module source file to the provided block.
     def define_module(&block)
       yield '#define PY_SSIZE_T_CLEAN'
@@ -602,39 +1112,254 @@ module Wrapture
       yield '  #define Py_READONLY READONLY'
       yield '#endif'
 
-      @spec.definition_includes.each do |include_file|
+      if async?
+        yield '#include <pthread.h>'
+        yield '#include <stdlib.h>'
+      end
+
+      if ufuncs?
+        yield "#ifdef #{NUMPY_MACRO}"
+        yield '  #define NPY_NO_DEPRECATED_API NPY_1_7_API_VERSION'
+        yield '  #include <numpy/ndarraytypes.h>'
+        yield '  #include <numpy/ufuncobject.h>'
+        yield '#endif'
+      end
+
+      yield '#include <stdint.h>' if serializable_classes? || stdint_params?
+      yield '#include <string.h>' if serializable_classes?
+
+      typemap_includes = @spec.typemaps.flat_map(&:includes)
+      (@spec.definition_includes + typemap_includes).uniq.each do |include_file|
         yield "#include <#{include_file}>"
       end
 
       yield ''
+      define_error_path_helpers(&block)
+      yield ''
+      if stdint_params?
+        define_stdint_converters(&block)
+        yield ''
+      end
+      if serializable_classes?
+        define_layout_header_helpers(&block)
+        yield ''
+      end
+      if async?
+        PythonAsyncPool.new(@spec.name).define(&block)
+        yield ''
+      end
+      if module_state?
+        define_module_state(&block)
+        yield ''
+      end
       define_scope_type_objects { |line| block.call(line) }
+      if @spec.lazy_types?
+        define_lazy_types(&block)
+        yield ''
+      end
+      define_module_exec(&block)
+      yield ''
+      define_module_def(&block)
+      yield ''
       yield 'PyMODINIT_FUNC'
       yield "PyInit_#{@spec.name}( void )"
       yield '{'
-      yield '  PyObject *m;'
-      yield ''
-      scope_types_ready { |line| block.call("  #{line}") }
-      yield "  m = PyModule_Create( &#{@spec.name}_module );"
-      yield '  if( !m ){'
-      yield '    return NULL;'
-      yield '  }'
-      yield ''
-      add_scope_type_objects { |line| block.call("  #{line}") }
-      yield '  return m;'
+      yield "  return PyModuleDef_Init( &#{@spec.name}_module );"
       yield '}'
     end
 
-    # Yields lines of C code to define all type objects and supporting functions
-    # for this module.
-    def define_scope_type_objects(&block)
-      yield "static struct PyModuleDef #{@spec.name}_module = {"
+    # Yields lines of C code defining the function run by multi-phase
+    # initialization to fill in a new module object.
+    #
+    # The heap types of the classes are created from their specs for each
+    # module object, parents first so that they can be given as the base of
+    # their children, and stored in the module state. If the scope has lazy
+    # types, the types and enums are instead left for the module __getattr__
+    # function to create when they are first used.
+    def define_module_exec(&block)
+      lazy = @spec.lazy_types?
+
+      yield 'static int'
+      yield "#{@spec.name}_exec( PyObject *m ) {"
+      if module_state? && !lazy
+        yield "  #{module_state_name} *state = " \
+              "( #{module_state_name} * ) PyModule_GetState( m );"
+        yield ''
+      end
+
+      if async?
+        yield '  if( async_pool_init() < 0 ){'
+        yield '    return -1;'
+        yield '  }'
+        yield ''
+      end
+
+      if ufuncs?
+        yield "#ifdef #{NUMPY_MACRO}"
+        yield '  if( _import_umath() < 0 ){'
+        yield '    return -1;'
+        yield '  }'
+        yield '#endif'
+        yield ''
+      end
+
+      if lazy
+        yield "  if( #{@spec.name}_module_set_all( m ) < 0 ){"
+        yield '    return -1;'
+        yield '  }'
+        yield ''
+      else
+        @spec.classes_in_creation_order.each do |class_spec|
+          define_type_creation(class_spec, 'return -1;') do |line|
+            block.call(line.empty? ? line : "  #{line}")
+          end
+
+          type_object = "state->#{self.class.type_object_name(class_spec)}"
+          yield "  if( PyModule_AddType( m, #{type_object} ) < 0 ){"
+          yield '    return -1;'
+          yield '  }'
+          yield ''
+        end
+
+        @spec.enums.each do |enum_spec|
+          yield "  if( !add_#{enum_spec.snake_case_name}_enum_to_module( m ) ){"
+          yield '    return -1;'
+          yield '  }'
+          yield ''
+        end
+      end
+
+      yield '  return 0;'
+      yield '}'
+    end
+
+    # Yields lines of C code defining the slots and definition of the module,
+    # along with the functions that let the garbage collector see the type
+    # objects held in the module state.
+    #
+    # The module may be imported into subinterpreters that each have their own
+    # GIL, as its types and state belong to a single module object. This is
+    # not supported if the module has an async thread pool, as the pool is
+    # shared across the process. The GIL is only declared as unused if the
+    # scope states that the wrapped library is thread safe.
+    def define_module_def
+      name = @spec.name
+      unsupported = 'Py_MOD_MULTIPLE_INTERPRETERS_NOT_SUPPORTED'
+      interpreters = if async?
+                       unsupported
+                     else
+                       'Py_MOD_PER_INTERPRETER_GIL_SUPPORTED'
+                     end
+      gil = @spec.thread_safe? ? 'Py_MOD_GIL_NOT_USED' : 'Py_MOD_GIL_USED'
+
+      if module_state?
+        define_module_state_functions { |line| yield line }
+        yield ''
+      end
+
+      yield "static PyModuleDef_Slot #{name}_slots[] = {"
+      yield "  { Py_mod_exec, #{name}_exec },"
+      yield '#ifdef Py_mod_multiple_interpreters'
+      if ufuncs? && !async?
+        yield "  #ifdef #{NUMPY_MACRO}"
+        yield "  { Py_mod_multiple_interpreters, #{unsupported} },"
+        yield '  #else'
+        yield "  { Py_mod_multiple_interpreters, #{interpreters} },"
+        yield '  #endif'
+      else
+        yield "  { Py_mod_multiple_interpreters, #{interpreters} },"
+      end
+      yield '#endif'
+      yield '#ifdef Py_mod_gil'
+      yield "  { Py_mod_gil, #{gil} },"
+      yield '#endif'
+      yield '  { 0, NULL }'
+      yield '};'
+      yield ''
+      yield "static struct PyModuleDef #{name}_module = {"
       yield '  PyModuleDef_HEAD_INIT,'
-      yield "  .m_name = \"#{@spec.name}\","
+      yield "  .m_name = \"#{name}\","
       yield '  .m_doc = NULL,'
-      yield '  .m_size = -1'
+      yield "  .m_methods = #{name}_module_methods," if @spec.lazy_types?
+      if module_state?
+        yield "  .m_size = sizeof( #{module_state_name} ),"
+        yield "  .m_slots = #{name}_slots,"
+        yield "  .m_traverse = #{name}_traverse,"
+        yield "  .m_clear = #{name}_clear,"
+        yield "  .m_free = #{name}_free"
+      else
+        yield '  .m_size = 0,'
+        yield "  .m_slots = #{name}_slots"
+      end
       yield '};'
+    end
+
+    # Yields lines of C code defining the state of the module, which holds the
+    # type objects of its classes. If any function needs to find the state,
+    # the function that finds it from one of the types of the module is also
+    # defined.
+    def define_module_state
+      name = @spec.name
+
+      yield 'typedef struct {'
+      state_type_objects.each do |type_object|
+        yield "  PyTypeObject *#{type_object};"
+      end
+      yield "} #{module_state_name};"
+
+      return unless module_state_lookup?
+
+      yield ''
+      yield "static struct PyModuleDef #{name}_module;"
       yield ''
+      yield "static #{module_state_name} *"
+      yield "#{name}_get_state( PyTypeObject *type ) {"
+      yield '  PyObject *module = ' \
+            "PyType_GetModuleByDef( type, &#{name}_module );"
+      yield ''
+      yield "  if #{UNLIKELY_MACRO}( !module ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield "  return ( #{module_state_name} * ) PyModule_GetState( module );"
+      yield '}'
+    end
 
+    # Yields lines of C code defining the traverse, clear, and free functions
+    # of the module, which visit and release the type objects in its state.
+    def define_module_state_functions
+      name = @spec.name
+      get_state = "#{module_state_name} *state = " \
+                  "( #{module_state_name} * ) PyModule_GetState( m );"
+      type_objects = state_type_objects.map do |type_object|
+        "state->#{type_object}"
+      end
+
+      yield 'static int'
+      yield "#{name}_traverse( PyObject *m, visitproc visit, void *arg ) {"
+      yield "  #{get_state}"
+      yield ''
+      type_objects.each { |type_object| yield "  Py_VISIT( #{type_object} );" }
+      yield '  return 0;'
+      yield '}'
+      yield ''
+      yield 'static int'
+      yield "#{name}_clear( PyObject *m ) {"
+      yield "  #{get_state}"
+      yield ''
+      type_objects.each { |type_object| yield "  Py_CLEAR( #{type_object} );" }
+      yield '  return 0;'
+      yield '}'
+      yield ''
+      yield 'static void'
+      yield "#{name}_free( void *m ) {"
+      yield "  #{name}_clear( ( PyObject * ) m );"
+      yield '}'
+    end
+
+    # Yields lines of C code to define all type objects and supporting functions
+    # for this module.
+    def define_scope_type_objects(&block)
       @spec.classes.select(&:factory?).each do |item|
         declare_factory_constructor(item, &block)
         yield ''
@@ -655,6 +1380,620 @@ module Wrapture
       end
     end
 
+    # Yields lines of C code defining the sequence protocol of the given class
+    # from the functions of its SequenceSpec, along with the iterator type
+    # returned by its tp_iter slot and its to_list method.
+    #
+    # Each item is fetched with a direct call of the wrapped item function, so
+    # iterating or converting to a list parses no arguments and looks up no
+    # methods. Iterators take the length when they are created.
+    def define_sequence(class_spec, &block)
+      sequence = class_spec.sequence
+      snake_name = class_spec.snake_case_name
+      type_struct = type_struct_name(class_spec)
+      iterator_struct = "#{snake_name}_iterator_struct"
+      index_param = sequence.index_param
+
+      yield 'static Py_ssize_t'
+      yield "#{snake_name}_sq_length( PyObject *obj ) {"
+      yield "  #{type_struct} *self = ( #{type_struct} * ) obj;"
+      yield '  Py_ssize_t length;'
+      function_locals(sequence.count) { |line| yield "  #{line}" }
+      yield ''
+      wrapped_call(sequence.count, &block)
+      yield ''
+      yield '  length = ( Py_ssize_t ) return_val;'
+      yield '  return length < 0 ? 0 : length;'
+      yield '}'
+      yield ''
+
+      yield 'static PyObject *'
+      yield "#{snake_name}_sequence_get( #{type_struct} *self, " \
+            'Py_ssize_t index ) {'
+      function_locals(sequence.item) { |line| yield "  #{line}" }
+      yield ''
+      if state_needed?([sequence.item])
+        state_lookup(state_type(sequence.item)) { |line| yield "  #{line}" }
+        yield ''
+      end
+      index_type = param_local_type(sequence.item, index_param)
+      yield "  #{index_param.name} = ( #{index_type} ) index;"
+      wrapped_call(sequence.item, &block)
+      yield ''
+      yield "  #{return_statement(sequence.item)}"
+      yield '}'
+      yield ''
+
+      yield 'static PyObject *'
+      yield "#{snake_name}_sq_item( PyObject *obj, Py_ssize_t index ) {"
+      yield "  if #{UNLIKELY_MACRO}( index < 0 || " \
+            "index >= #{snake_name}_sq_length( obj ) ){"
+      yield '    PyErr_SetString( PyExc_IndexError, ' \
+            "\"#{class_spec.name} index out of range\" );"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield "  return #{snake_name}_sequence_get( ( #{type_struct} * ) obj, " \
+            'index );'
+      yield '}'
+      yield ''
+
+      yield 'static PyObject *'
+      yield "#{snake_name}_to_list( #{type_struct} *self, " \
+            'PyObject *Py_UNUSED( ignored ) ) {'
+      yield "  Py_ssize_t length = #{snake_name}_sq_length( " \
+            '( PyObject * ) self );'
+      yield '  PyObject *list = PyList_New( length );'
+      yield '  PyObject *item;'
+      yield '  Py_ssize_t i;'
+      yield ''
+      yield "  if #{UNLIKELY_MACRO}( !list ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield '  for( i = 0; i < length; i++ ){'
+      yield "    item = #{snake_name}_sequence_get( self, i );"
+      yield "    if #{UNLIKELY_MACRO}( !item ){"
+      yield '      Py_DECREF( list );'
+      yield '      return NULL;'
+      yield '    }'
+      yield '    PyList_SET_ITEM( list, i, item );'
+      yield '  }'
+      yield ''
+      yield '  return list;'
+      yield '}'
+      yield ''
+
+      yield 'typedef struct {'
+      yield '  PyObject_HEAD'
+      yield '  PyObject *sequence;'
+      yield '  Py_ssize_t index;'
+      yield '  Py_ssize_t length;'
+      yield "} #{iterator_struct};"
+      yield ''
+      yield 'static void'
+      yield "#{snake_name}_iterator_dealloc( #{iterator_struct} *self ) {"
+      yield '  PyTypeObject *type = Py_TYPE( self );'
+      yield ''
+      yield '  Py_XDECREF( self->sequence );'
+      yield '  type->tp_free( ( PyObject * ) self );'
+      yield '  Py_DECREF( type );'
+      yield '}'
+      yield ''
+      yield 'static PyObject *'
+      yield "#{snake_name}_iterator_next( #{iterator_struct} *self ) {"
+      yield '  if( self->index >= self->length ){'
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield "  return #{snake_name}_sequence_get( " \
+            "( #{type_struct} * ) self->sequence, self->index++ );"
+      yield '}'
+      yield ''
+      yield "static PyType_Slot #{snake_name}_iterator_type_slots[] = {"
+      yield "  { Py_tp_dealloc, #{snake_name}_iterator_dealloc },"
+      yield '  { Py_tp_iter, PyObject_SelfIter },'
+      yield "  { Py_tp_iternext, #{snake_name}_iterator_next },"
+      yield '  { 0, NULL }'
+      yield '};'
+      yield ''
+      yield "static PyType_Spec #{snake_name}_iterator_type_spec = {"
+      yield "  .name = \"#{@spec.name}.#{class_spec.name}Iterator\","
+      yield "  .basicsize = sizeof( #{iterator_struct} ),"
+      yield '  .itemsize = 0,'
+      yield '  .flags = Py_TPFLAGS_DEFAULT,'
+      yield "  .slots = #{snake_name}_iterator_type_slots"
+      yield '};'
+      yield ''
+
+      yield 'static PyObject *'
+      yield "#{snake_name}_iter( PyObject *obj ) {"
+      yield "  #{module_state_name} *state;"
+      yield "  #{iterator_struct} *iterator;"
+      yield ''
+      state_lookup('Py_TYPE( obj )') { |line| yield "  #{line}" }
+      yield ''
+      yield "  iterator = PyObject_New( #{iterator_struct}, " \
+            "state->#{iterator_type_object_name(class_spec)} );"
+      yield "  if #{UNLIKELY_MACRO}( !iterator ){"
+      yield '    return NULL;'
+      yield '  }'
+      yield ''
+      yield '  Py_INCREF( obj );'
+      yield '  iterator->sequence = obj;'
+      yield '  iterator->index = 0;'
+      yield "  iterator->length = #{snake_name}_sq_length( obj );"
+      yield ''
+      yield '  return ( PyObject * ) iterator;'
+      yield '}'
+    end
+
+    # Yields lines of C code defining the functions of a serializable class
+    # that copy its struct to and from bytes, along with its buffer protocol
+    # and __reduce_ex__ method.
+    #
+    # With pickle protocol 5 the struct is given as a PickleBuffer over the
+    # object itself rather than copied into bytes, so that it can be passed
+    # out-of-band. Older protocols are given the bytes from to_bytes.
+    def define_serialization(class_spec, &block)
+      snake_name = class_spec.snake_case_name
+      type_struct = type_struct_name(class_spec)
+      struct_size = "sizeof( struct #{class_spec.struct.name} )"
+      fingerprint = class_spec.struct.layout_fingerprint
+      header_size = LAYOUT_HEADER_SIZE
+      serialized_size = "#{header_size} + #{struct_size}"
+      align = ' ' * snake_name.length
+      length_error = "the bytes of a #{class_spec.name} must be " \
+                     "#{header_size} bytes longer than its struct"
+
+      <<~CTEXT.each_line(chomp: true, &block)
+        static PyObject *
+        #{snake_name}_from_layout( PyTypeObject *type,
+                      #{align}const unsigned char *header,
+                      #{align}const void *data ) {
+          #{type_struct} *self;
+          int checked;
+
+          checked = check_layout_header( header, #{fingerprint},
+                                         #{struct_size} );
+          if #{UNLIKELY_MACRO}( checked != 0 ) {
+            return NULL;
+          }
+
+          self = ( #{type_struct} * ) type->tp_alloc( type, 0 );
+          if #{UNLIKELY_MACRO}( !self ) {
+            return NULL;
+          }
+
+          memcpy( &self->equivalent, data, #{struct_size} );
+          return ( PyObject * ) self;
+        }
+
+        static PyObject *
+        #{snake_name}_to_bytes( #{type_struct} *self,
+                   #{align}PyObject *Py_UNUSED( ignored ) ) {
+          PyObject *bytes;
+          unsigned char *buffer;
+
+          bytes = PyBytes_FromStringAndSize( NULL, #{serialized_size} );
+          if #{UNLIKELY_MACRO}( !bytes ) {
+            return NULL;
+          }
+
+          buffer = ( unsigned char * ) PyBytes_AS_STRING( bytes );
+          write_layout_header( buffer, #{fingerprint}, #{struct_size} );
+          memcpy( buffer + #{header_size}, &self->equivalent,
+                  #{struct_size} );
+          return bytes;
+        }
+
+        static PyObject *
+        #{snake_name}_from_bytes( PyObject *cls, PyObject *data ) {
+          Py_buffer view;
+          const unsigned char *bytes;
+          PyObject *result;
+
+          if #{UNLIKELY_MACRO}( PyObject_GetBuffer( data, &view,
+                                                 PyBUF_SIMPLE ) != 0 ) {
+            return NULL;
+          }
+
+          if #{UNLIKELY_MACRO}( view.len != #{serialized_size} ) {
+            PyErr_SetString( PyExc_ValueError, "#{length_error}" );
+            result = NULL;
+          } else {
+            bytes = ( const unsigned char * ) view.buf;
+            result = #{snake_name}_from_layout( ( PyTypeObject * ) cls, bytes,
+                                   #{align}bytes + #{header_size} );
+          }
+
+          PyBuffer_Release( &view );
+          return result;
+        }
+
+        static PyObject *
+        #{snake_name}_from_pickle( PyObject *cls, PyObject *args ) {
+          Py_buffer header;
+          Py_buffer data;
+          PyObject *result;
+
+          if #{UNLIKELY_MACRO}( !PyArg_ParseTuple( args, "y*y*",
+                                                &header, &data ) ) {
+            return NULL;
+          }
+
+          if #{UNLIKELY_MACRO}( header.len != #{header_size} ||
+                                 data.len != #{struct_size} ) {
+            PyErr_SetString( PyExc_ValueError, "#{length_error}" );
+            result = NULL;
+          } else {
+            result = #{snake_name}_from_layout( ( PyTypeObject * ) cls,
+                                   #{align}header.buf, data.buf );
+          }
+
+          PyBuffer_Release( &header );
+          PyBuffer_Release( &data );
+          return result;
+        }
+
+        static PyObject *
+        #{snake_name}_reduce_ex( #{type_struct} *self, PyObject *protocol ) {
+          unsigned char header[#{header_size}];
+          PyObject *type;
+          PyObject *constructor;
+          PyObject *state;
+          PyObject *result;
+          long version;
+
+          version = PyLong_AsLong( protocol );
+          if #{UNLIKELY_MACRO}( version == -1 && PyErr_Occurred() ) {
+            return NULL;
+          }
+
+          type = ( PyObject * ) Py_TYPE( self );
+          if( version < 5 ) {
+            constructor = PyObject_GetAttrString( type, "from_bytes" );
+            state = #{snake_name}_to_bytes( self, NULL );
+          } else {
+            write_layout_header( header, #{fingerprint}, #{struct_size} );
+            constructor = PyObject_GetAttrString( type, "_from_pickle" );
+            state = PyPickleBuffer_FromObject( ( PyObject * ) self );
+          }
+
+          if #{UNLIKELY_MACRO}( !constructor || !state ) {
+            result = NULL;
+          } else if( version < 5 ) {
+            result = Py_BuildValue( "O(O)", constructor, state );
+          } else {
+            result = Py_BuildValue( "O(y#O)", constructor, header,
+                                    ( Py_ssize_t ) #{header_size}, state );
+          }
+
+          Py_XDECREF( constructor );
+          Py_XDECREF( state );
+          return result;
+        }
+
+        static int
+        #{snake_name}_getbuffer( #{type_struct} *self, Py_buffer *view,
+                    #{align}int flags ) {
+          return PyBuffer_FillInfo( view, ( PyObject * ) self,
+                                    &self->equivalent, #{struct_size}, 1,
+                                    flags );
+        }
+      CTEXT
+    end
+
+    # Yields lines of C code defining the converters given to PyArg_ParseTuple
+    # for parameters with an integer type of stdint.h, which raise an
+    # OverflowError for integers out of the range of the type.
+    def define_stdint_converters
+      stdint_params.each_with_index do |type, i|
+        yield '' unless i.zero?
+        unsigned = type.start_with?('u')
+        value_type = unsigned ? 'unsigned long long' : 'long long'
+        conversion = "PyLong_As#{unsigned ? 'Unsigned' : ''}LongLong"
+        limit = STDINT_LIMIT_MAP[type]
+
+        yield 'static int'
+        yield "#{stdint_converter_name(type)}( PyObject *obj, void *result ) {"
+        yield "  #{value_type} value;"
+        yield ''
+        yield "  value = #{conversion}( obj );"
+        yield "  if #{UNLIKELY_MACRO}( value == ( #{value_type} ) -1 && " \
+              'PyErr_Occurred() ) {'
+        yield '    return 0;'
+        yield '  }'
+        yield ''
+        if limit
+          range_check = "value > #{limit}_MAX"
+          range_check = "value < #{limit}_MIN || #{range_check}" unless unsigned
+          yield "  if #{UNLIKELY_MACRO}( #{range_check} ) {"
+          yield '    PyErr_SetString( PyExc_OverflowError, ' \
+                "\"the integer is out of range for #{type}\" );"
+          yield '    return 0;'
+          yield '  }'
+          yield ''
+        end
+        yield "  *( #{type} * ) result = ( #{type} ) value;"
+        yield '  return 1;'
+        yield '}'
+      end
+    end
+
+    # Yields each line of the setup.py script for this scope.
+    def define_setup(&block)
+      build = @spec.build
+      sources = ["#{@spec.name}.c"] + build['sources']
+      libraries = build['sources'].empty? ? @spec.libraries : []
+      compile_args = []
+      link_args = []
+
+      if build['optimize']
+        compile_args.concat(%w[-O3 -flto -fvisibility=hidden])
+        link_args.concat(%w[-O3 -flto])
+      end
+
+      if build['static'] && !libraries.empty?
+        link_args << '-Wl,-Bstatic'
+        link_args.concat(libraries.map { |lib| "-l#{lib}" })
+        link_args << '-Wl,-Bdynamic'
+        libraries = []
+      end
+
+      library_dirs = python_list((['.'] + build['library-dirs']).uniq)
+      include_dirs = python_list((['.'] + build['include-dirs']).uniq)
+      cflags = python_list(compile_args)
+      ldflags = python_list(link_args)
+      # the ufuncs are only built if NumPy is available when building
+      mod = "#{@spec.name}_mod"
+      numpy_check = if ufuncs?
+                      <<~NUMPYTEXT
+                        try:
+                          import numpy
+                          #{mod}.include_dirs.append(numpy.get_include())
+                          #{mod}.define_macros.append(('#{NUMPY_MACRO}', None))
+                        except ImportError:
+                          pass
+
+                      NUMPYTEXT
+                    end
+
+      <<~SETUPTEXT.each_line(chomp: true, &block)
+        from setuptools import setup, Extension
+
+        #{@spec.name}_mod = Extension('#{@spec.name}',
+                                      language = 'c',
+                                      sources = #{python_list(sources)},
+                                      libraries = #{python_list(libraries)},
+                                      library_dirs = #{library_dirs},
+                                      include_dirs = #{include_dirs},
+                                      extra_compile_args = #{cflags},
+                                      extra_link_args = #{ldflags})
+
+        #{numpy_check}setup(name = '#{@spec.name}',
+              version = '1.0', # todo create a scope version number
+              description = '#{@spec.doc.text}', # todo this should be better
+              ext_modules = [#{@spec.name}_mod])
+      SETUPTEXT
+    end
+
+    # Yields lines of C code that create the heap type of the given class and
+    # store it in the module state, along with the type of the iterators of
+    # its sequence if it has one. The parent of the class must already have
+    # been created. The given +failure+ statement is used if any step fails.
+    def define_type_creation(class_spec, failure)
+      type_object = "state->#{self.class.type_object_name(class_spec)}"
+      parent = class_spec.child? && class_spec.parent_spec
+      bases = if parent
+                "( PyObject * ) state->#{self.class.type_object_name(parent)}"
+              else
+                'NULL'
+              end
+      type_spec = "&#{class_spec.snake_case_name}_type_spec"
+
+      yield "#{type_object} = ( PyTypeObject * ) " \
+            "PyType_FromModuleAndSpec( m, #{type_spec}, #{bases} );"
+      yield "if( !#{type_object} ){"
+      yield "  #{failure}"
+      yield '}'
+      yield ''
+
+      unless class_spec.constants.empty?
+        constants_function = class_constants_function_name(class_spec)
+        yield "if( #{constants_function}( #{type_object} ) < 0 ){"
+        yield "  #{failure}"
+        yield '}'
+        yield ''
+      end
+
+      unless ufunc_functions(class_spec).empty?
+        ufuncs_function = "#{class_spec.snake_case_name}_add_ufuncs"
+        yield "#ifdef #{NUMPY_MACRO}"
+        yield "if( #{ufuncs_function}( #{type_object} ) < 0 ){"
+        yield "  #{failure}"
+        yield '}'
+        yield '#endif'
+        yield ''
+      end
+
+      return unless class_spec.sequence
+
+      iterator_object = "state->#{iterator_type_object_name(class_spec)}"
+      iterator_spec = "&#{class_spec.snake_case_name}_iterator_type_spec"
+      yield "#{iterator_object} = ( PyTypeObject * ) " \
+            "PyType_FromModuleAndSpec( m, #{iterator_spec}, NULL );"
+      yield "if( !#{iterator_object} ){"
+      yield "  #{failure}"
+      yield '}'
+      yield ''
+    end
+
+    # Yields lines of C code defining a function that gives the type of the
+    # given class in a module with lazy types, creating it if this has not
+    # been done yet.
+    #
+    # The parent of the class is created first so that it can be the base of
+    # the type. The classes that the functions of the class depend on are
+    # created once the type is in the state, so that classes depending on each
+    # other find it instead of creating it again, and the type is only added
+    # to the module once all of them have been created.
+    def define_type_ready_function(class_spec, &block)
+      type_object = "state->#{self.class.type_object_name(class_spec)}"
+      parent = class_spec.child? && class_spec.parent_spec
+
+      yield 'static PyTypeObject *'
+      yield "#{type_ready_function_name(class_spec)}( " \
+            "PyObject *m, #{module_state_name} *state ) {"
+      yield "  if( #{type_object} ){"
+      yield "    return #{type_object};"
+      yield '  }'
+      yield ''
+
+      if parent
+        yield "  if( !#{type_ready_function_name(parent)}( m, state ) ){"
+        yield '    return NULL;'
+        yield '  }'
+        yield ''
+        yield '  // the parent may have created this type as a dependency'
+        yield "  if( #{type_object} ){"
+        yield "    return #{type_object};"
+        yield '  }'
+        yield ''
+      end
+
+      define_type_creation(class_spec, 'goto error;') do |line|
+        block.call(line.empty? ? line : "  #{line}")
+      end
+
+      lazy_dependencies(class_spec).each do |dependency|
+        yield "  if( !#{type_ready_function_name(dependency)}( m, state ) ){"
+        yield '    goto error;'
+        yield '  }'
+        yield ''
+      end
+
+      yield "  if( PyModule_AddType( m, #{type_object} ) < 0 ){"
+      yield '    goto error;'
+      yield '  }'
+      yield ''
+      yield "  return #{type_object};"
+      yield ''
+      yield 'error:'
+      yield "  Py_CLEAR( #{type_object} );"
+      if class_spec.sequence
+        yield "  Py_CLEAR( state->#{iterator_type_object_name(class_spec)} );"
+      end
+      yield '  return NULL;'
+      yield '}'
+    end
+
+    # Yields lines of C code defining the inner loop of the ufunc of the given
+    # function, along with the arrays of loops, data, and types given to NumPy
+    # when the ufunc is created. The locals of the loop are prefixed with
+    # wrapture_ so that they do not collide with the names of the parameters.
+    def define_ufunc_loop(func_spec)
+      loop_name = "#{function_wrapper_name(func_spec)}_loop"
+      params = func_spec.params
+      types = params.map { |param_spec| param_spec.type.name }
+      types << func_spec.return_type.name
+      element_types = types.map { |type| ufunc_element_type(type) }
+      out = params.length
+      call = func_spec.wrapped.call_from(self.class.new(func_spec))
+      result = if func_spec.return_type.name == 'bool'
+                 "#{call} ? NPY_TRUE : NPY_FALSE"
+               else
+                 "( #{element_types[out]} ) #{call}"
+               end
+      contiguous = element_types.each_with_index.map do |type, i|
+        "wrapture_steps[#{i}] == sizeof( #{type} )"
+      end
+
+      yield 'static void'
+      yield "#{loop_name}( char **wrapture_args,"
+      indent = ' ' * (loop_name.length + 2)
+      yield "#{indent}const npy_intp *wrapture_dimensions,"
+      yield "#{indent}const npy_intp *wrapture_steps,"
+      yield "#{indent}void *Py_UNUSED( wrapture_data ) ) {"
+      yield '  const npy_intp wrapture_count = wrapture_dimensions[0];'
+      yield '  npy_intp wrapture_i;'
+      yield ''
+      yield "  if( #{contiguous.join(" &&\n      ")} ){"
+      element_types.each_with_index do |type, i|
+        qualifier = i == out ? '' : 'const '
+        yield "    #{qualifier}#{type} *wrapture_values_#{i} = " \
+              "( #{qualifier}#{type} * ) wrapture_args[#{i}];"
+      end
+      yield ''
+      yield '    for( wrapture_i = 0; wrapture_i < wrapture_count; ' \
+            'wrapture_i++ ){'
+      params.each_with_index do |param_spec, i|
+        yield "      #{element_types[i]} #{param_spec.name} = " \
+              "wrapture_values_#{i}[wrapture_i];"
+      end
+      yield "      wrapture_values_#{out}[wrapture_i] = #{result};"
+      yield '    }'
+      yield '  } else {'
+      yield '    for( wrapture_i = 0; wrapture_i < wrapture_count; ' \
+            'wrapture_i++ ){'
+      params.each_with_index do |param_spec, i|
+        yield "      #{element_types[i]} #{param_spec.name} = " \
+              "*( const #{element_types[i]} * ) " \
+              "( wrapture_args[#{i}] + wrapture_i * wrapture_steps[#{i}] );"
+      end
+      yield "      *( #{element_types[out]} * ) " \
+            "( wrapture_args[#{out}] + wrapture_i * wrapture_steps[#{out}] ) " \
+            "= #{result};"
+      yield '    }'
+      yield '  }'
+      yield '}'
+      yield ''
+      yield "static PyUFuncGenericFunction #{loop_name}s[] = { #{loop_name} };"
+      yield "static void *#{loop_name}_data[] = { NULL };"
+      numpy_types = types.map { |type| NUMPY_TYPE_MAP[type] }
+      yield "static char #{loop_name}_types[] = { #{numpy_types.join(', ')} };"
+    end
+
+    # Yields lines of C code defining the inner loop of each ufunc of the
+    # given class, along with a function adding the ufuncs to its type.
+    #
+    # The loops call the wrapped function directly for each element. Arrays
+    # that are contiguous get a loop indexing them as plain C arrays, which
+    # the compiler is able to vectorize if the wrapped function is visible
+    # to it, while other arrays are stepped through by their strides.
+    def define_ufuncs(class_spec, &block)
+      funcs = ufunc_functions(class_spec)
+      funcs.each do |func_spec|
+        define_ufunc_loop(func_spec, &block)
+        yield ''
+      end
+
+      yield 'static int'
+      yield "#{class_spec.snake_case_name}_add_ufuncs( PyTypeObject *type ) {"
+      yield '  PyObject *dict = type->tp_dict;'
+      yield '  PyObject *ufunc;'
+      funcs.each do |func_spec|
+        loop_name = "#{function_wrapper_name(func_spec)}_loop"
+        ufunc_name = "#{func_spec.name}_ufunc"
+        yield ''
+        yield "  ufunc = PyUFunc_FromFuncAndData( #{loop_name}s, " \
+              "#{loop_name}_data, #{loop_name}_types, 1, " \
+              "#{func_spec.params.length}, 1, PyUFunc_None, " \
+              "\"#{ufunc_name}\", \"#{func_spec.doc.text}\", 0 );"
+        yield '  if( !ufunc ||'
+        yield "      PyDict_SetItemString( dict, \"#{ufunc_name}\", " \
+              'ufunc ) < 0 ){'
+        yield '    Py_XDECREF( ufunc );'
+        yield '    return -1;'
+        yield '  }'
+        yield '  Py_DECREF( ufunc );'
+      end
+      yield ''
+      yield '  PyType_Modified( type );'
+      yield '  return 0;'
+      yield '}'
+    end
+
     # The declaration of the equivalent member of this class.
     def equivalent_member_declaration(class_spec)
       if class_spec.pointer_wrapper?
@@ -669,7 +2008,8 @@ module Wrapture
     # A factory constructor creates an instance of a class based on a struct
     # that is overloaded.
     def define_factory_constructor(class_spec)
-      param_decl = "struct #{class_spec.struct.name} *equivalent"
+      param_decl = "#{module_state_name} *state, " \
+                   "struct #{class_spec.struct.name} *equivalent"
       yield "PyObject * new_#{class_spec.name}( #{param_decl} ){"
       yield '  PyTypeObject *type;'
       yield '  PyObject *obj;'
@@ -678,7 +2018,7 @@ module Wrapture
       class_spec.scope.overloads(class_spec).each do |overload|
         check = overload.struct.rules_check('equivalent')
         yield "  #{line_prefix}if( #{check} ) {"
-        yield "    type = &#{self.class.type_object_name(overload)};"
+        yield "    type = state->#{self.class.type_object_name(overload)};"
         struct_type = self.class.type_struct_name(overload)
         yield "    #{struct_type} *new_#{struct_type};"
         struct_name = "new_#{struct_type}"
@@ -691,7 +2031,7 @@ module Wrapture
       end
 
       yield "  #{line_prefix}{"
-      yield "    type = &#{self.class.type_object_name(class_spec)};"
+      yield "    type = state->#{self.class.type_object_name(class_spec)};"
       struct_type = self.class.type_struct_name(class_spec)
       yield "    #{struct_type} *new_#{struct_type};"
       alloc_call = "(#{struct_type} *) type->tp_alloc( type, 0 )"
@@ -704,6 +2044,23 @@ module Wrapture
       yield '}'
     end
 
+    # The name of the Py*_Check function that validates an argument for the
+    # given PyArg_ParseTuple format unit, or nil if no check is needed. If
+    # +exact+ is false, the check also accepts arguments that the format unit
+    # is able to convert.
+    def format_unit_check(format_unit, exact)
+      case format_unit
+      when 'b', 'B', 'h', 'H', 'i', 'I', 'l', 'L', 'k', 'K', 'n'
+        'PyLong_Check'
+      when 'f', 'd'
+        exact ? 'PyFloat_Check' : 'PyNumber_Check'
+      when 'p'
+        'PyBool_Check' if exact
+      when 's'
+        'PyUnicode_Check'
+      end
+    end
+
     # The format string for PyArg_ParseTuple for the given function.
     def function_args_format(func_spec)
       required_formats = func_spec.required_params.map do |param_spec|
@@ -717,17 +2074,21 @@ module Wrapture
       "#{required_formats.join}|#{optional_formats.join}"
     end
 
-    # Gives the flags used to define the python method for the given function.
-    def function_flags(func_spec)
+    # Gives the flags used to define the python method for the given group of
+    # functions sharing a name.
+    def function_flags(func_group)
+      func_spec = func_group.first
       flags = []
 
-      flags << if func_spec.params.empty?
+      flags << if func_group.length == 1 && func_spec.params.empty?
                  'METH_NOARGS'
                else
                  'METH_VARARGS'
                end
 
-      flags << 'METH_STATIC' if func_spec.static?
+      # static functions are class methods so that they are given the type,
+      # which is needed to find the module state
+      flags << 'METH_CLASS' if func_spec.static?
 
       flags.join(' | ')
     end
@@ -741,19 +2102,11 @@ module Wrapture
       end
 
       unless func_spec.void_return?
-        effective_return = func_spec.wrapped.return_val_type
-        if effective_return.name == 'void'
-          effective_return = func_spec.return_type
-        end
-        effective_return = func_spec.resolve_type(effective_return)
-
-        if effective_return.name == 'bool'
-          yield 'long return_val;'
-        else
-          yield "#{effective_return} return_val;"
-        end
+        yield "#{return_val_type(func_spec)} return_val;"
       end
 
+      yield "#{module_state_name} *state;" if state_needed?([func_spec])
+
       function_param_locals(func_spec, &block)
     end
 
@@ -763,12 +2116,7 @@ module Wrapture
       return unless spec.params?
 
       spec.params.each do |param_spec|
-        param_type_spec = spec.resolve_type(param_spec.type)
-        param_type = if spec.owner.scope.type?(param_type_spec)
-                       "#{self.class.type_struct_name(param_type_spec)} *"
-                     else
-                       param_type_spec.to_s
-                     end
+        param_type = param_local_type(spec, param_spec)
         yield "#{param_type} #{param_spec.name}#{suffix};"
       end
 
@@ -787,8 +2135,10 @@ module Wrapture
       end
     end
 
-    # A list of parameters for the given function's wrapper.
-    def function_params(func_spec)
+    # A list of parameters for the given function's wrapper. If +varargs+ is
+    # true then an argument tuple is accepted even if the function itself has
+    # no parameters, as is needed for dispatching between overloads.
+    def function_params(func_spec, varargs: func_spec.params?)
       owner_snake_name = func_spec.owner.snake_case_name
       type_struct_name = "#{owner_snake_name}_type_struct"
 
@@ -801,10 +2151,10 @@ module Wrapture
       else
         params << "#{type_struct_name} *self"
 
-        params << if func_spec.params.empty?
-                    'PyObject *Py_UNUSED( ignored )'
-                  else
+        params << if varargs
                     'PyObject *args'
+                  else
+                    'PyObject *Py_UNUSED( ignored )'
                   end
       end
 
@@ -824,6 +2174,34 @@ module Wrapture
       end
     end
 
+    # Gives the name of the field of the module state holding the type object
+    # of the iterators of the sequence of a given class.
+    def iterator_type_object_name(class_spec)
+      "#{class_spec.snake_case_name}_iterator_type_object"
+    end
+
+    # The classes that must be created along with the given class in a module
+    # with lazy types. These are the classes taken or returned by its
+    # functions, along with the overloads of those returned as overloaded,
+    # since the wrappers of the functions use their type objects.
+    def lazy_dependencies(class_spec)
+      dependencies = class_functions(class_spec).flat_map do |func_spec|
+        types = func_spec.params.map(&:type) << func_spec.return_type
+        classes = types.map do |type|
+          @spec.type(func_spec.resolve_type(type))
+        end.compact
+
+        if func_spec.return_overloaded?
+          returned = @spec.type(func_spec.resolve_type(func_spec.return_type))
+          classes.concat(@spec.overloads(returned)) if returned
+        end
+
+        classes
+      end
+
+      dependencies.uniq - [class_spec]
+    end
+
     # A constructor to create a class based on its equivalent struct members.
     def member_constructor(class_spec)
       spec_hash = member_constructor_hash(class_spec)
@@ -842,16 +2220,193 @@ module Wrapture
         'wrapped-code' => { 'lines' => assignments } }
     end
 
-    # The Python member type symbol to use for this type, suitable for use with
-    # the PyMemberDef.type struct field.
-    def member_type(type_spec)
-      MEMBER_TYPE_MAP.fetch(type_spec.name, 'Py_T_OBJECT_EX')
+    # True if the module has a state, which is the case if it has any classes
+    # whose type objects the state holds.
+    def module_state?
+      @spec.classes.any?
+    end
+
+    # True if any function of the module needs to find the module state.
+    def module_state_lookup?
+      @spec.classes.any? do |class_spec|
+        class_spec.sequence || class_function_groups(class_spec).any? do |group|
+          state_needed?(group)
+        end
+      end
+    end
+
+    # The name of the struct holding the state of the module.
+    def module_state_name
+      "#{@spec.name}_state"
+    end
+
+    # A list of argument counts accepted by the functions in the given group,
+    # each paired with the indices of the functions that accept it.
+    def overload_arities(func_group)
+      arities = Hash.new { |hash, key| hash[key] = [] }
+
+      func_group.each_with_index do |func_spec, i|
+        min_count = func_spec.required_params.length
+        (min_count..func_spec.params.length).each do |arg_count|
+          arities[arg_count] << i
+        end
+      end
+
+      arities.sort.to_h
+    end
+
+    # Yields the lines of C code that select and call one of the +candidates+
+    # for a call with +arg_count+ arguments. All candidates are first checked
+    # for an exact type match, then for a loose one, and finally the first
+    # candidate that accepts arguments of any type is called.
+    def overload_dispatch(func_group, candidates, arg_count)
+      base_name = function_wrapper_name(func_group[0])
+      fallback = nil
+      loose_candidates = []
+
+      [true, false].each do |exact|
+        (exact ? candidates : loose_candidates).each do |i|
+          func_spec = func_group[i]
+          checks = overload_arg_checks(func_spec, arg_count, exact: exact)
+
+          if checks.empty?
+            fallback ||= i
+            next
+          end
+
+          loose_checks = overload_arg_checks(func_spec, arg_count, exact: false)
+          loose_candidates << i if exact && checks != loose_checks
+
+          call_args = overload_call_args(func_spec)
+          yield "if( #{checks.join(' && ')} ){"
+          yield "  return #{base_name}_#{i}( #{call_args} );"
+          yield '}'
+        end
+      end
+
+      if fallback
+        call_args = overload_call_args(func_group[fallback])
+        yield "return #{base_name}_#{fallback}( #{call_args} );"
+      else
+        yield 'break;'
+      end
+    end
+
+    # A list of C expressions checking the types of the first +arg_count+
+    # arguments for the given function. Arguments that are accepted regardless
+    # of type are not checked. If +exact+ is false, then arguments are also
+    # accepted if they are convertible to the parameter type, for example an
+    # int for a double parameter.
+    def overload_arg_checks(func_spec, arg_count, exact: true)
+      func_spec.params.first(arg_count).each_with_index.map do |param_spec, i|
+        arg = "PyTuple_GET_ITEM( args, #{i} )"
+        param_type = func_spec.resolve_type(param_spec.type)
+
+        param_class = func_spec.owner.scope.type(param_type)
+        if param_class
+          type_object = self.class.type_object_name(param_class)
+          "PyObject_TypeCheck( #{arg}, state->#{type_object} )"
+        else
+          check = param_check(func_spec, param_spec, exact)
+          check && "#{check}( #{arg} )"
+        end
+      end.compact
+    end
+
+    # The arguments used to call one of the functions of an overloaded group.
+    def overload_call_args(func_spec)
+      if func_spec.constructor?
+        'type, args, kwds'
+      else
+        'self, args'
+      end
+    end
+
+    # A human-readable signature of the given function, suitable for use in
+    # error messages.
+    def overload_signature(func_spec)
+      params = func_spec.params.map do |param_spec|
+        "#{func_spec.resolve_type(param_spec.type)} #{param_spec.name}"
+      end
+
+      "#{python_name(func_spec)}(#{params.join(', ')})"
+    end
+
+    # True if any class of the module has overloaded functions, which are
+    # dispatched by a group wrapper.
+    def overloaded_functions?
+      @spec.classes.any? do |class_spec|
+        class_function_groups(class_spec).any? { |group| group.length > 1 }
+      end
+    end
+
+    # The type of the local variable holding the given parameter of a function
+    # once it has been parsed.
+    def param_local_type(func_spec, param_spec)
+      param_type_spec = func_spec.resolve_type(param_spec.type)
+      if func_spec.owner.scope.type?(param_type_spec)
+        "#{self.class.type_struct_name(param_type_spec)} *"
+      else
+        param_type_spec.to_s
+      end
+    end
+
+    # The name of the Py*_Check function that validates an argument for the
+    # given function parameter, or nil if no check is needed. Parameters
+    # converted by a typemap use the check it gives, if any.
+    def param_check(func_spec, param_spec, exact)
+      type = func_spec.resolve_type(param_spec.type).to_s
+      typemap = @spec.typemap(type)
+
+      if typemap&.from_python
+        typemap.check
+      elsif STDINT_LIMIT_MAP.key?(type)
+        'PyLong_Check'
+      else
+        format_unit_check(param_format(func_spec, param_spec), exact)
+      end
+    end
+
+    # The name of the converter function given along with the given function
+    # parameter to PyArg_ParseTuple, or nil if the parameter does not use the
+    # O& format unit.
+    def param_converter(func_spec, param_spec)
+      type = func_spec.resolve_type(param_spec.type).to_s
+      typemap = @spec.typemap(type)
+
+      if typemap&.from_python
+        typemap.from_python
+      elsif STDINT_LIMIT_MAP.key?(type)
+        stdint_converter_name(type)
+      end
     end
 
     # The format string for PyArg_ParseTuple for the given function parameter.
+    # Classes of the scope are given as objects. A WrapError is raised for
+    # any other type that cannot be converted.
     def param_format(func_spec, param_spec)
-      key = func_spec.resolve_type(param_spec.type).to_s
-      TYPE_FORMAT_UNIT_MAP.fetch(key, 'O')
+      return 'O&' if param_converter(func_spec, param_spec)
+
+      type = func_spec.resolve_type(param_spec.type)
+      key = type.to_s
+      return TYPE_FORMAT_UNIT_MAP[key] if TYPE_FORMAT_UNIT_MAP.key?(key)
+      return 'O' if func_spec.owner.scope.type?(type)
+
+      raise WrapError, unsupported_type_message(key)
+    end
+
+    # The name of the given function as seen from Python.
+    def python_name(func_spec)
+      if func_spec.constructor? || func_spec.destructor?
+        func_spec.owner.name
+      else
+        func_spec.name
+      end
+    end
+
+    # A Python list literal of the given strings.
+    def python_list(items)
+      "[#{items.map { |item| "'#{item}'" }.join(', ')}]"
     end
 
     # The return statement used in this function's definition.
@@ -864,7 +2419,7 @@ module Wrapture
         'Py_RETURN_NONE;'
       elsif func_spec.return_overloaded?
         overload_function = "new_#{func_spec.return_type.name.chomp('*').strip}"
-        "return #{overload_function}( return_val );"
+        "return #{overload_function}( state, return_val );"
       else
         return_value = create_python_object(func_spec.return_type, 'return_val')
         if return_value.empty?
@@ -875,17 +2430,111 @@ module Wrapture
       end
     end
 
-    # Passes lines of C code to the given block which executes PyType_Ready
-    # on each type in the module.
-    def scope_types_ready
-      @spec.classes.each do |item|
-        yield "if ( PyType_Ready( &#{item.snake_case_name}_type_object ) < 0){"
-        yield '  return NULL;'
-        yield '}'
-        yield ''
+    # The type of the variable holding the return value of the wrapped call of
+    # the given function.
+    def return_val_type(func_spec)
+      effective_return = func_spec.wrapped.return_val_type
+      if effective_return.name == 'void'
+        effective_return = func_spec.return_type
+      end
+      effective_return = func_spec.resolve_type(effective_return)
+
+      effective_return.name == 'bool' ? 'long' : effective_return.to_s
+    end
+
+    # True if any class of the scope is serializable.
+    def serializable_classes?
+      @spec.classes.any?(&:serializable?)
+    end
+
+    # The name, flags, and documentation of each method added to a
+    # serializable class.
+    def serialization_methods(class_spec)
+      name = class_spec.name
+      [['to_bytes', 'METH_NOARGS',
+        "Gives the bytes of this #{name}, headed by its struct layout."],
+       ['from_bytes', 'METH_O | METH_CLASS',
+        "Creates a #{name} from the bytes given by to_bytes."],
+       ['_from_pickle', 'METH_VARARGS | METH_CLASS',
+        "Creates a #{name} from the header and struct given by pickle."],
+       ['__reduce_ex__', 'METH_O',
+        "Gives the constructor and arguments that pickle a #{name}."]]
+    end
+
+    # The name of the converter given to PyArg_ParseTuple for parameters of
+    # the given integer type of stdint.h.
+    def stdint_converter_name(type)
+      "convert_to_#{type}"
+    end
+
+    # A list of the integer types of stdint.h taken as parameters by the
+    # functions of the scope without a typemap of their own, each of which
+    # needs a converter.
+    def stdint_params
+      types = @spec.classes.flat_map do |class_spec|
+        class_functions(class_spec).flat_map do |func_spec|
+          func_spec.params.map do |param_spec|
+            func_spec.resolve_type(param_spec.type).to_s
+          end
+        end
+      end
+
+      types.uniq.select do |type|
+        STDINT_LIMIT_MAP.key?(type) && !@spec.typemap(type)&.from_python
       end
     end
 
+    # True if any function of the scope takes an integer type of stdint.h.
+    def stdint_params?
+      !stdint_params.empty?
+    end
+
+    # Yields the lines of C code that set +state+ to the module state, found
+    # from the type given by +type+, returning NULL if it cannot be found.
+    def state_lookup(type)
+      yield "state = #{@spec.name}_get_state( #{type} );"
+      yield "if #{UNLIKELY_MACRO}( !state ){"
+      yield '  return NULL;'
+      yield '}'
+    end
+
+    # True if the wrappers of the given group of functions need the module
+    # state. This is the case if one of them returns an overloaded class, which
+    # is created from a type object in the state, or if the group checks the
+    # arguments against the types of the module to choose an overload.
+    def state_needed?(func_group)
+      func_group.any?(&:return_overloaded?) || typed_overloads?(func_group)
+    end
+
+    # An expression for the type that the module state is found from in the
+    # wrapper of the given function, where +owner+ is the object the function
+    # was called on. Constructors are given the type being created, and static
+    # functions are class methods that are given the class itself.
+    def state_type(func_spec, owner = 'self')
+      if func_spec.constructor?
+        'type'
+      elsif func_spec.static?
+        "( PyTypeObject * ) #{owner}"
+      else
+        "Py_TYPE( #{owner} )"
+      end
+    end
+
+    # The names of the fields of the module state holding type objects, which
+    # are those of the classes followed by those of the iterators of their
+    # sequences.
+    def state_type_objects
+      type_objects = @spec.classes.map do |class_spec|
+        self.class.type_object_name(class_spec)
+      end
+
+      @spec.classes.select(&:sequence).each do |class_spec|
+        type_objects << iterator_type_object_name(class_spec)
+      end
+
+      type_objects
+    end
+
     # Gives a code snippet that accesses the equivalent struct from within the
     # class using the given variable name.
     def this_struct(class_spec, var_name: 'self')
@@ -920,11 +2569,64 @@ module Wrapture
       end
     end
 
+    # The name of the function giving the type of the given class in a module
+    # with lazy types.
+    def type_ready_function_name(class_spec)
+      "ready_#{class_spec.snake_case_name}_type"
+    end
+
     # The name of the structure used to wrap objects of the given Named type.
     def type_struct_name(named_type)
       "#{named_type.snake_case_name}_type_struct"
     end
 
+    # True if the given group of functions is overloaded and has a parameter
+    # with the type of a class of the module, which is checked against the type
+    # object of the class when choosing an overload.
+    def typed_overloads?(func_group)
+      func_group.length > 1 && func_group.any? do |func_spec|
+        func_spec.params.any? do |param_spec|
+          func_spec.owner.scope.type?(func_spec.resolve_type(param_spec.type))
+        end
+      end
+    end
+
+    # The C type of the elements of a NumPy array holding the given type.
+    def ufunc_element_type(type)
+      type == 'bool' ? 'npy_bool' : type
+    end
+
+    # The functions of the given class registered as NumPy ufuncs. Raises a
+    # WrapError if one of these cannot be a ufunc.
+    def ufunc_functions(class_spec)
+      funcs = class_spec.method_specs
+      funcs.select(&:ufunc?).each do |func_spec|
+        if funcs.count { |other| other.name == func_spec.name } > 1
+          raise WrapError, "overloaded function #{func_spec.name} cannot " \
+                           'be a ufunc'
+        end
+
+        types = func_spec.params.map { |param_spec| param_spec.type.name }
+        types << func_spec.return_type.name
+        next if types.all? { |type| NUMPY_TYPE_MAP.key?(type) }
+
+        raise WrapError, "#{func_spec.name} cannot be a ufunc, as it takes " \
+                         'or returns a type that is not numeric'
+      end
+    end
+
+    # True if any class of the scope has functions registered as ufuncs.
+    def ufuncs?
+      @spec.classes.any? { |class_spec| !ufunc_functions(class_spec).empty? }
+    end
+
+    # The message of the error raised for a type that has no conversion to or
+    # from a Python object.
+    def unsupported_type_message(type_name)
+      "#{type_name} cannot be converted to or from a Python object, a " \
+        'typemap must be given for it in the scope'
+    end
+
     # Yields the lines to call the given function spec's wrapped code or
     # function.
     def wrapped_call(func_spec)
@@ -939,7 +2641,9 @@ module Wrapture
     def wrapped_function_call(func_spec)
       call = func_spec.wrapped.call_from(self.class.new(func_spec))
 
-      if func_spec.constructor?
+      if func_spec.in_place?
+        call
+      elsif func_spec.constructor?
         "#{this_struct_pointer(func_spec.owner)} = #{call}"
       elsif func_spec.wrapped.error_check? || !func_spec.void_return?
         "return_val = #{call}"
@@ -18,6 +18,7 @@
 # limitations under the License.
 #++
 
+require 'json'
 require 'yaml'
 
 module Wrapture
@@ -26,7 +27,15 @@ module Wrapture
     include Enumerable
     include Named
 
-    # Creates a scope containing all of the specs in the given files.
+    # The options that may be given in the build key of a scope.
+    BUILD_KEYS = %w[include-dirs library-dirs optimize sources static].freeze
+
+    # The keys of a scope spec that are merged into the scope itself, rather
+    # than describing the specs that it contains.
+    OPTION_KEYS = %w[build doc lazy-types name thread-safe version].freeze
+
+    # Creates a scope containing all of the specs in the given files. See
+    # load_spec_file for the formats that the files may be in.
     def self.load_files(*filenames)
       scope = Scope.new
 
@@ -37,6 +46,17 @@ module Wrapture
       scope
     end
 
+    # Loads the spec hash in the given file. Files with a +.json+ extension are
+    # parsed as JSON, and all others as YAML. Both give the same hash for the
+    # same spec, so files of either format can be merged into a scope.
+    def self.load_spec_file(spec_filename)
+      if File.extname(spec_filename).casecmp?('.json')
+        JSON.parse(File.read(spec_filename))
+      else
+        YAML.safe_load_file(spec_filename)
+      end
+    end
+
     # Returns a normalized copy of a scope hash specification. See
     # normalize_spec_hash! for details.
     def self.normalize_spec_hash(spec, *templates)
@@ -55,11 +75,13 @@ module Wrapture
     def self.normalize_spec_hash!(spec, *templates)
       # the templates must be handled first, since they might add keys needed
       # for the spec to be valid
+      record_class_template_uses(spec, *templates)
       TemplateSpec.replace_all_uses(spec, *templates)
       spec['templates'] = [] unless spec.key?('templates')
       new_templates = spec['templates'].collect do |template_hash|
         TemplateSpec.new(template_hash)
       end
+      record_class_template_uses(spec, *new_templates)
       TemplateSpec.replace_all_uses(spec, *new_templates)
 
       if spec.key?('doc')
@@ -69,6 +91,9 @@ module Wrapture
       end
 
       spec['version'] = Wrapture.spec_version(spec)
+      Wrapture.normalize_boolean!(spec, 'lazy-types')
+      Wrapture.normalize_boolean!(spec, 'thread-safe')
+      normalize_build!(spec)
 
       spec['classes'] = [] unless spec.key?('classes')
       spec['classes'].each do |class_hash|
@@ -80,9 +105,72 @@ module Wrapture
         EnumSpec.normalize_spec_hash!(enum_hash)
       end
 
+      typemaps = spec.fetch('typemaps', [])
+      unless typemaps.is_a?(Array)
+        raise InvalidSpecKey, 'the typemaps key must be a list of typemaps'
+      end
+
+      spec['typemaps'] = typemaps.map do |typemap_hash|
+        TypemapSpec.normalize_spec_hash(typemap_hash)
+      end
+
       spec
     end
 
+    # The names of the templates used anywhere in the given spec.
+    def self.template_uses(spec)
+      case spec
+      when Hash
+        uses = spec.values.flat_map { |value| template_uses(value) }
+        use = spec[TEMPLATE_USE_KEYWORD]
+        uses << (use.is_a?(Hash) ? use['name'] : use) if use
+        uses.uniq
+      when Array
+        spec.flat_map { |value| template_uses(value) }.uniq
+      else
+        []
+      end
+    end
+
+    # Normalizes the build options of a scope spec in place, defaulting each
+    # option that is not given.
+    def self.normalize_build!(spec)
+      build = spec.fetch('build', {})
+      unless build.is_a?(Hash)
+        raise InvalidSpecKey, 'the build key must be a map of options'
+      end
+
+      extra_keys = build.keys - BUILD_KEYS
+      unless extra_keys.empty?
+        raise InvalidSpecKey.new("#{extra_keys.join(', ')} not build options",
+                                 valid_keys: BUILD_KEYS)
+      end
+
+      %w[include-dirs library-dirs sources].each do |key|
+        build[key] = Wrapture.normalize_array(build[key])
+      end
+      Wrapture.normalize_boolean!(build, 'optimize')
+      Wrapture.normalize_boolean!(build, 'static')
+
+      spec['build'] = build
+    end
+    private_class_method :normalize_build!
+
+    # Records the uses of class templates among the given templates by the
+    # classes of a scope spec in their +class-template+ key, so that they are
+    # still known once the templates have been expanded.
+    def self.record_class_template_uses(spec, *templates)
+      return unless spec['classes'].is_a?(Array)
+
+      spec['classes'].each do |class_hash|
+        next unless class_hash.is_a?(Hash)
+
+        use = ClassSpec.class_template_use(class_hash, *templates)
+        class_hash['class-template'] = use if use
+      end
+    end
+    private_class_method :record_class_template_uses
+
     # A list of classes currently in the scope.
     attr_reader :classes
 
@@ -95,12 +183,32 @@ module Wrapture
     # A list of the templates defined in the scope.
     attr_reader :templates
 
+    # A list of the TypemapSpecs of the scope.
+    attr_reader :typemaps
+
     # Creates an empty scope, optionally with the provided specification.
     #
     # Since a scope can be completely empty, all of the following keys are
     # optional in the specification hash.
+    # build:: a map of options for building the generated wrappers, which may
+    # contain the following keys:
+    # include-dirs::: directories to search for the headers of the library
+    # library-dirs::: directories to search for the wrapped libraries
+    # optimize::: set to true to build with -O3, link time optimization, and
+    # hidden visibility
+    # sources::: C sources of the library to compile into the wrapper
+    # itself, instead of linking the libraries of the scope
+    # static::: set to true to link the libraries of the scope from static
+    # archives
     # doc:: a string containing the documentation for this class
+    # lazy-types:: set to true to create the types and enums of the generated
+    # Python module when they are first used rather than when it is imported
     # name:: the explicit name of this scope
+    # thread-safe:: set to true if the wrapped library may be called from
+    # several threads at once, allowing wrappers to run without a GIL
+    # typemaps:: a list of conversions between types of the wrapped library
+    # and Python objects, used by the Python wrapper for types it cannot
+    # convert on its own. See TypemapSpec for details.
     def initialize(spec = {})
       @classes = []
       @enums = []
@@ -109,6 +217,10 @@ module Wrapture
       @spec = self.class.normalize_spec_hash(spec)
       @doc = Comment.new(@spec['doc'])
 
+      @typemaps = @spec['typemaps'].collect do |typemap_hash|
+        TypemapSpec.new(typemap_hash)
+      end
+
       @templates = @spec['templates'].collect do |template_hash|
         TemplateSpec.new(template_hash)
       end
@@ -120,6 +232,16 @@ module Wrapture
       @spec['enums'].each do |enum_hash|
         EnumSpec.new(enum_hash, scope: self)
       end
+
+      # what each merged file added to the scope is kept so that the files can
+      # be merged again on their own, under the nil key for the given spec
+      options = Marshal.load(Marshal.dump(@spec.slice(*OPTION_KEYS)))
+      @sources = { nil => { 'classes' => @classes.dup,
+                            'enums' => @enums.dup,
+                            'options' => options,
+                            'templates' => @templates.dup,
+                            'typemaps' => @typemaps.dup,
+                            'uses' => [] } }
     end
 
     # Adds a class or template specification to the scope.
@@ -145,6 +267,40 @@ module Wrapture
       @enums << EnumSpec.new(spec)
     end
 
+    # The build options of this scope, as a normalized hash. See the +build+
+    # key of ::new for the options.
+    def build
+      @spec['build']
+    end
+
+    # A list of the ClassFamilySpecs of the classes in this scope that are
+    # wrapped as a class template, one for each template they use.
+    def class_families
+      families = @classes.select(&:class_template).group_by do |class_spec|
+        class_spec.class_template.name
+      end
+
+      families.values.map do |members|
+        ClassFamilySpec.new(members.first.class_template, members, self)
+      end
+    end
+
+    # The classes of this scope, ordered so that each parent comes before its
+    # children.
+    def classes_in_creation_order
+      ordered = []
+      add_class = lambda do |class_spec|
+        next if ordered.include?(class_spec)
+
+        parent = class_spec.child? && class_spec.parent_spec
+        add_class.call(parent) if parent
+        ordered << class_spec
+      end
+
+      @classes.each(&add_class)
+      ordered
+    end
+
     # An array of includes needed to define everything in this scope.
     def definition_includes
       flat_map(&:definition_includes).uniq
@@ -158,12 +314,32 @@ module Wrapture
       self
     end
 
+    # True if the types of the generated Python module are created on first
+    # use instead of when the module is imported.
+    def lazy_types?
+      @spec['lazy-types']
+    end
+
+    # The names of the files merged into this scope, in the order that they
+    # were merged.
+    def files
+      @sources.keys.compact
+    end
+
+    # The classes and enumerations that the given merged file added to this
+    # scope.
+    def file_specs(spec_filename)
+      source = @sources.fetch(spec_filename, {})
+      source.fetch('classes', []) + source.fetch('enums', [])
+    end
+
     # An array of libraries needed for everything in this scope.
     def libraries
       flat_map(&:libraries).uniq
     end
 
-    # Merges the scope defined in the given filename into this one.
+    # Merges the scope defined in the given filename into this one. The file
+    # may be in any of the formats supported by ::load_spec_file.
     #
     # If the new spec specifies a name and this spec already has one that is
     # different, this will raise a KeyConflict error.
@@ -176,38 +352,8 @@ module Wrapture
     # not provided, meaning that if the version was not given in both specs
     # then this will be the current Wrapture version.
     def merge_file(spec_filename)
-      new_spec = YAML.safe_load_file(spec_filename)
-      self.class.normalize_spec_hash!(new_spec, *@templates)
-
-      both_named = @spec.key?('name') && new_spec.key?('name')
-      if both_named && @spec['name'] != new_spec['name']
-        msg = "'#{new_spec['name']}' conflicts current name '#{@spec['name']}'"
-        raise KeyConflict, msg
-      end
-
-      versions = [@spec['version'], new_spec['version']]
-      @spec['version'] = Wrapture.max_version(*versions)
-
-      new_doc = Comment.new(new_spec['doc'])
-      unless new_doc.empty?
-        if @doc.empty?
-          @doc = new_doc
-        else
-          @doc << '\n\n' << new_doc
-        end
-      end
-
-      new_spec['templates'].each do |template_hash|
-        @templates << TemplateSpec.new(template_hash)
-      end
-
-      new_spec['classes'].each do |class_hash|
-        ClassSpec.new(class_hash, scope: self)
-      end
-
-      new_spec['enums'].each do |enum_hash|
-        EnumSpec.new(enum_hash, scope: self)
-      end
+      new_spec = self.class.load_spec_file(spec_filename)
+      @sources[spec_filename] = merge_spec(new_spec)
 
       self
     end
@@ -252,6 +398,42 @@ module Wrapture
       @classes.any? { |class_spec| class_spec.overloads?(parent) }
     end
 
+    # True if a class in this scope names the given class as its parent.
+    def parent?(class_spec)
+      @classes.any? { |spec| spec.parent_name == class_spec.name }
+    end
+
+    # Merges the given files into this scope again after they have changed,
+    # returning the names of the files that were merged. Files merged after
+    # one of these that use a template it defined are merged again as well,
+    # since the expansion of the template may have changed. All other files
+    # keep the specs that they added, without being loaded again.
+    #
+    # The specs of the scope keep the order of the files that they came from,
+    # so the result is the same as loading all of the files again. If a file
+    # cannot be merged, the scope is left as it was and the error is raised.
+    def reload_files(*filenames)
+      reloaded = reload_order(filenames)
+      state = [@spec, @doc, @classes, @enums, @templates, @typemaps]
+      sources = @sources.dup
+
+      begin
+        remerge_sources(reloaded)
+      rescue StandardError
+        @spec, @doc, @classes, @enums, @templates, @typemaps = state
+        @sources = sources
+        raise
+      end
+
+      reloaded
+    end
+
+    # True if the wrapped library of this scope may be called from several
+    # threads at once.
+    def thread_safe?
+      @spec['thread-safe']
+    end
+
     # Returns the ClassSpec for the given +type+ in the scope, if one exists.
     def type(type)
       name = case type
@@ -266,6 +448,11 @@ module Wrapture
       @classes.find { |class_spec| class_spec.name == name }
     end
 
+    # Returns the TypemapSpec for the given +type+ in the scope, if one exists.
+    def typemap(type)
+      @typemaps.find { |typemap| typemap.type == type.to_s }
+    end
+
     # Returns true if there is a class matching the given +type+ in this scope.
     def type?(type)
       name = case type
@@ -279,5 +466,113 @@ module Wrapture
 
       @classes.any? { |class_spec| class_spec.name == name }
     end
+
+    private
+
+    # Merges the scope options of a normalized spec into this scope.
+    def merge_options(options)
+      both_named = @spec.key?('name') && options.key?('name')
+      if both_named && @spec['name'] != options['name']
+        msg = "'#{options['name']}' conflicts current name '#{@spec['name']}'"
+        raise KeyConflict, msg
+      end
+
+      versions = [@spec['version'], options['version']]
+      @spec['version'] = Wrapture.max_version(*versions)
+
+      @spec['lazy-types'] ||= options['lazy-types']
+      @spec['thread-safe'] ||= options['thread-safe']
+      @spec['build'].merge!(options['build']) do |_, current, new|
+        current.is_a?(Array) ? (current + new).uniq : current || new
+      end
+
+      new_doc = Comment.new(options['doc'])
+      return if new_doc.empty?
+
+      if @doc.empty?
+        @doc = new_doc
+      else
+        @doc << '\n\n' << new_doc
+      end
+    end
+
+    # Merges the given spec hash into this scope, returning a record of what
+    # it added.
+    def merge_spec(new_spec)
+      uses = self.class.template_uses(new_spec)
+      self.class.normalize_spec_hash!(new_spec, *@templates)
+
+      options = new_spec.slice(*OPTION_KEYS)
+      merge_options(options)
+      class_count = @classes.length
+      enum_count = @enums.length
+
+      templates = new_spec['templates'].collect do |template_hash|
+        TemplateSpec.new(template_hash)
+      end
+      @templates.concat(templates)
+
+      typemaps = new_spec['typemaps'].collect do |typemap_hash|
+        TypemapSpec.new(typemap_hash)
+      end
+      @typemaps.concat(typemaps)
+
+      new_spec['classes'].each do |class_hash|
+        ClassSpec.new(class_hash, scope: self)
+      end
+
+      new_spec['enums'].each do |enum_hash|
+        EnumSpec.new(enum_hash, scope: self)
+      end
+
+      { 'classes' => @classes.drop(class_count),
+        'enums' => @enums.drop(enum_count),
+        'options' => options,
+        'templates' => templates,
+        'typemaps' => typemaps,
+        'uses' => uses }
+    end
+
+    # Rebuilds this scope from the records of its sources, loading and merging
+    # the given files again instead of using their records.
+    def remerge_sources(reloaded)
+      base = @sources[nil]
+      @spec = Marshal.load(Marshal.dump(base['options']))
+      @doc = Comment.new(@spec['doc'])
+      @classes = base['classes'].dup
+      @enums = base['enums'].dup
+      @templates = base['templates'].dup
+      @typemaps = base['typemaps'].dup
+
+      files.each do |spec_filename|
+        if reloaded.include?(spec_filename)
+          new_spec = self.class.load_spec_file(spec_filename)
+          @sources[spec_filename] = merge_spec(new_spec)
+          next
+        end
+
+        source = @sources[spec_filename]
+        merge_options(source['options'])
+        @templates.concat(source['templates'])
+        @typemaps.concat(source['typemaps'])
+        @classes.concat(source['classes'])
+        @enums.concat(source['enums'])
+      end
+    end
+
+    # The files that must be merged again if the given files change, in the
+    # order that they were merged. This includes the files themselves and
+    # any later files using a template defined in one of them.
+    def reload_order(filenames)
+      changed_templates = []
+
+      files.select do |spec_filename|
+        source = @sources[spec_filename]
+        reload = filenames.include?(spec_filename) ||
+                 source['uses'].any? { |use| changed_templates.include?(use) }
+        changed_templates.concat(source['templates'].map(&:name)) if reload
+        reload
+      end
+    end
   end
 end
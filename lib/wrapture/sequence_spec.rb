@@ -0,0 +1,112 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # A collection that a class exposes through a pair of its functions, one
+  # giving the number of items in the collection and the other giving the
+  # item at an index. Wrappers use this to let the class be used as a
+  # sequence in the target language.
+  class SequenceSpec
+    # Normalizes a hash specification of a sequence. Normalization checks for
+    # missing and invalid keys.
+    def self.normalize_spec_hash(spec)
+      unless spec.is_a?(Hash)
+        raise InvalidSpecKey, 'a sequence must be a map of its functions'
+      end
+
+      required_keys = %w[count item]
+      missing_keys = required_keys - spec.keys
+      unless missing_keys.empty?
+        missing_msg = "required keys are missing: #{missing_keys.join(', ')}"
+        raise(MissingSpecKey, missing_msg)
+      end
+
+      extra_keys = spec.keys - required_keys
+      unless extra_keys.empty?
+        extra_msg = "these keys are unrecognized: #{extra_keys.join(', ')}"
+        raise(InvalidSpecKey, extra_msg)
+      end
+
+      spec.dup
+    end
+
+    # The function giving the number of items in the sequence.
+    attr_reader :count
+
+    # The function giving the item at an index of the sequence.
+    attr_reader :item
+
+    # The class that the sequence belongs to.
+    attr_reader :owner
+
+    # Creates a sequence of the given class from the provided spec, which
+    # names the functions of the class that give the sequence.
+    #
+    # The spec must have the following keys:
+    # count:: the name of a function taking no parameters that returns the
+    # number of items in the sequence
+    # item:: the name of a function taking only an index that returns the
+    # item at that index
+    #
+    # Neither function may be static or overloaded.
+    def initialize(spec, owner)
+      @spec = SequenceSpec.normalize_spec_hash(spec)
+      @owner = owner
+
+      @count = find_function('count')
+      unless @count.params.empty? && !@count.void_return?
+        raise InvalidSpecKey, "#{@count.name} must take no parameters and " \
+                              'return the number of items of the sequence'
+      end
+
+      @item = find_function('item')
+      return if @item.params.length == 1 && !@item.void_return?
+
+      raise InvalidSpecKey, "#{@item.name} must take only an index and " \
+                            'return the item at it'
+    end
+
+    # The parameter of the item function giving the index of the item.
+    def index_param
+      @item.params.first
+    end
+
+    private
+
+    # The function of the owner named by the given key of the spec, raising an
+    # error if it cannot be used for the sequence.
+    def find_function(key)
+      name = @spec[key]
+      functions = @owner.functions.select do |func_spec|
+        func_spec.name == name && !func_spec.constructor? &&
+          !func_spec.destructor?
+      end
+
+      if functions.empty?
+        raise InvalidSpecKey, "#{name} is not a function of #{@owner.name}"
+      elsif functions.length > 1 || functions.first.static?
+        raise InvalidSpecKey, "#{name} cannot be overloaded or static to be " \
+                              'used in a sequence'
+      end
+
+      functions.first
+    end
+  end
+end
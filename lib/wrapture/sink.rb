@@ -0,0 +1,150 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # A destination for generated source files.
+  #
+  # Wrappers yield generated code one line at a time. A sink collects these
+  # lines into large buffers before handing them to the underlying target, so
+  # that generation does not cost a write call per line.
+  #
+  # The target of a sink may be one of the following:
+  # callable:: any object responding to +call+, which is given the name of
+  #            each file and returns an IO to write its contents to. The IO
+  #            is closed once the file is written.
+  # Hash:: each file is stored as a String under its filename
+  # IO:: any object responding to +write+, which receives the contents of a
+  #      single file. Writing a second file to it raises a WrapError, as
+  #      there would be no way to tell the files apart.
+  # String:: the name of a directory, in which a file is created for each
+  #          generated file
+  class Sink
+    # The number of bytes buffered before a write to an IO target is made.
+    BUFFER_SIZE = 65_536
+
+    # Gives a Sink for the given target. If +target+ is already a Sink, it is
+    # returned as is.
+    def self.for(target)
+      target.is_a?(Sink) ? target : new(target)
+    end
+
+    # The object that files are written to.
+    attr_reader :target
+
+    # Creates a sink writing to the given target. See the class documentation
+    # for the types of targets supported.
+    def initialize(target)
+      valid_target = target.is_a?(Hash) ||
+                     target.is_a?(String) ||
+                     target.respond_to?(:call) ||
+                     target.respond_to?(:write)
+      unless valid_target
+        raise WrapError, "#{target.class} cannot be used as a sink target"
+      end
+
+      @target = target
+      @written = nil
+    end
+
+    # Writes a file with the given name to this sink, returning the filename.
+    #
+    # The provided block is given a Proc which accepts one line of the file
+    # at a time, in the same way that +puts+ does: a newline is appended to
+    # each line unless it already has one, and nil is an empty line.
+    def write_file(filename, &block)
+      case @target
+      when Hash
+        write_string(filename, &block)
+      when String
+        File.open(File.join(@target, filename), 'w') do |file|
+          write_io(file, &block)
+        end
+      else
+        if @target.respond_to?(:call)
+          write_factory(filename, &block)
+        else
+          write_single_io(filename, &block)
+        end
+      end
+
+      filename
+    end
+
+    private
+
+    # Appends a line to the given buffer.
+    def append_line(buffer, line)
+      text = line.to_s
+      buffer << text
+      buffer << "\n" unless text.end_with?("\n")
+    end
+
+    # Writes a file to the IO given for its name by the callable target, and
+    # closes the IO afterwards.
+    def write_factory(filename, &block)
+      io = @target.call(filename)
+      unless io.respond_to?(:write)
+        raise WrapError, "the sink target gave no IO to write #{filename} to"
+      end
+
+      begin
+        write_io(io, &block)
+      ensure
+        io.close if io.respond_to?(:close)
+      end
+    end
+
+    # Writes the lines given to the block to an IO object in large chunks.
+    def write_io(io)
+      buffer = String.new(capacity: BUFFER_SIZE * 2)
+
+      yield(proc do |line|
+        append_line(buffer, line)
+        if buffer.bytesize >= BUFFER_SIZE
+          io.write(buffer)
+          buffer.clear
+        end
+      end)
+
+      io.write(buffer) unless buffer.empty?
+    end
+
+    # Writes a file to the IO target, which may only hold one file.
+    def write_single_io(filename, &block)
+      if @written
+        raise WrapError, "cannot write #{filename} to an IO sink already " \
+                         "holding #{@written}, use a callable target giving " \
+                         'an IO for each file instead'
+      end
+
+      @written = filename
+      write_io(@target, &block)
+    end
+
+    # Collects the lines given to the block into a String in the Hash target.
+    # The String is left to grow as needed rather than preallocated, as it is
+    # kept for as long as the Hash is.
+    def write_string(filename)
+      buffer = +''
+      yield proc { |line| append_line(buffer, line) }
+      @target[filename] = buffer
+    end
+  end
+end
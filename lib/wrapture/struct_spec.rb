@@ -66,6 +66,19 @@ module Wrapture
       @spec['includes'].dup
     end
 
+    # A 64 bit FNV-1a hash of the name of the struct and the types and names of
+    # its members, given as a C literal. Serialized structs carry this so that
+    # they are not read with a different layout than they were written with.
+    def layout_fingerprint
+      fields = members.map { |member| "#{member['type']} #{member['name']};" }
+      layout = "struct #{name} { #{fields.join(' ')} }"
+      hash = layout.each_byte.reduce(0xcbf29ce484222325) do |current, byte|
+        ((current ^ byte) * 0x100000001b3) & 0xffffffffffffffff
+      end
+
+      format('0x%016xULL', hash)
+    end
+
     # A string containing the typed members of the struct, separated by commas.
     def member_list
       members = @spec['members'].map do |member|
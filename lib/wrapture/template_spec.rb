@@ -217,6 +217,50 @@ module Wrapture
   # be inserted directly into the position rather than merged with other hash or
   # array members. If the more complex merging functionality is needed, then
   # consider invoking a template instead of using a parameter.
+  #
+  # = Class Templates
+  #
+  # A template for a whole class may have a +class-template+ member, which
+  # generates the C++ wrappers of the classes instantiated from it as a single
+  # C++ class template instead of a separate class for each. The member may be
+  # set to the name to give the class template, or to true to use the name of
+  # the template in CamelCase.
+  #
+  # Each parameter of such a template may only be used as the name of a
+  # wrapped function. The class template takes a traits struct holding each of
+  # these functions as its parameter, and each class instantiated from the
+  # template is declared as an alias for the class template instantiated with
+  # its own traits:
+  #
+  #   templates:
+  #     - name: "counter-class"
+  #       class-template: "Counter"
+  #       value:
+  #         namespace: "counters"
+  #         equivalent-struct:
+  #           name: "counter"
+  #           includes: "counter.h"
+  #         functions:
+  #           - name: "Increment"
+  #             wrapped-function:
+  #               name:
+  #                 is-param: true
+  #                 name: "increment-function"
+  #               params:
+  #                 - value: "equivalent-struct-pointer"
+  #   classes:
+  #     - name: "FastCounter"
+  #       use-template:
+  #         name: "counter-class"
+  #         params:
+  #           - name: "increment-function"
+  #             value: "fast_increment"
+  #
+  # This gives a +Counter+ class template in a single +Counter.hpp+ and
+  # +Counter.cpp+, with +FastCounter+ declared as
+  # <code>Counter<FastCounterTraits></code>. Only classes that give nothing
+  # besides a name, documentation, and the template invocation are generated
+  # this way, others are generated as usual.
   class TemplateSpec
     # Replaces all instances of the given templates in the provided spec. This
     # is done recursively until no more changes can be made. Returns true if
@@ -302,6 +346,21 @@ module Wrapture
       @spec = spec
     end
 
+    # True if the classes instantiated from this template are wrapped as a
+    # single class template.
+    def class_template?
+      @spec.fetch('class-template', false) ? true : false
+    end
+
+    # The name of the class template that the classes instantiated from this
+    # template are wrapped as.
+    def class_template_name
+      class_template = @spec['class-template']
+      return class_template if class_template.is_a?(String)
+
+      name.split(/[-_\s]+/).map(&:capitalize).join
+    end
+
     # True if the given spec is a reference to this template that will be
     # completely replaced by the template. A direct use can be recognized as
     # a hash with only a 'use-template' key and no others.
@@ -0,0 +1,107 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # A conversion between a type of the wrapped library and Python objects,
+  # made by functions supplied along with the library. Python wrappers use
+  # these for types that they cannot convert on their own, such as typedefs
+  # of the library.
+  class TypemapSpec
+    # The keys that a typemap may have.
+    KEYS = %w[check from-python includes to-python type].freeze
+
+    # Normalizes a hash specification of a typemap. Normalization checks for
+    # missing and invalid keys, and turns the includes into a list.
+    def self.normalize_spec_hash(spec)
+      unless spec.is_a?(Hash)
+        raise InvalidSpecKey, 'a typemap must be a map of a type and the ' \
+                              'functions converting it'
+      end
+
+      raise(MissingSpecKey, 'a typemap must have a type') unless spec['type']
+
+      extra_keys = spec.keys - KEYS
+      unless extra_keys.empty?
+        raise InvalidSpecKey.new("#{extra_keys.join(', ')} not typemap keys",
+                                 valid_keys: KEYS)
+      end
+
+      unless spec.key?('from-python') || spec.key?('to-python')
+        raise MissingSpecKey, "the typemap of #{spec['type']} must have a " \
+                              'from-python or to-python function'
+      end
+
+      normalized = spec.dup
+      normalized['includes'] = Wrapture.normalize_array(spec['includes'])
+      normalized
+    end
+
+    # Creates a typemap from the provided spec.
+    #
+    # The spec must have the following keys:
+    # type:: the name of the type converted by the typemap
+    #
+    # The spec must also have at least one of the following:
+    # from-python:: the name of a function converting a Python object to the
+    # type, which is given to PyArg_ParseTuple with the O& format unit. It
+    # must take the object and a pointer to the type as a void pointer, and
+    # return 1 if it succeeds or 0 with an exception set if it fails.
+    # to-python:: the name of a function taking a value of the type and
+    # returning a new reference to a Python object, or NULL with an exception
+    # set if it fails
+    #
+    # The following keys are optional:
+    # check:: the name of a function or macro taking a Python object that is
+    # true if it can be converted to the type, used to choose between
+    # overloaded functions, such as PyFloat_Check
+    # includes:: a list of headers declaring the functions of the typemap
+    def initialize(spec)
+      @spec = TypemapSpec.normalize_spec_hash(spec)
+    end
+
+    # The name of the function checking that an object can be converted to
+    # the type, or nil if there is none.
+    def check
+      @spec['check']
+    end
+
+    # The name of the function converting a Python object to the type, or nil
+    # if there is none.
+    def from_python
+      @spec['from-python']
+    end
+
+    # A list of the headers declaring the functions of the typemap.
+    def includes
+      @spec['includes'].dup
+    end
+
+    # The name of the function converting the type to a Python object, or nil
+    # if there is none.
+    def to_python
+      @spec['to-python']
+    end
+
+    # The name of the type converted by the typemap.
+    def type
+      @spec['type']
+    end
+  end
+end
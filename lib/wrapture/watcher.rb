@@ -0,0 +1,302 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+#--
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#++
+
+module Wrapture
+  # Keeps a Scope loaded from a set of spec files in memory, and generates its
+  # wrappers again each time one of the files changes.
+  #
+  # Only the changed files are merged into the scope again, along with any
+  # files using the templates they define. Likewise, only the C++ sources of
+  # the classes and enums affected by a change are generated again, along with
+  # the files generated for the whole scope such as the Python module. A
+  # generated file is only written if its contents changed.
+  #
+  # The C++ and Python wrappers are generated and written separately, so that
+  # an error generating one of them does not keep the other from being
+  # written.
+  #
+  # Changes are detected with inotify where it is available, and by polling
+  # the modification times of the files otherwise.
+  class Watcher
+    # The inotify events signaling that a file in a watched directory changed,
+    # which are IN_CLOSE_WRITE, IN_MOVED_TO, and IN_CREATE.
+    INOTIFY_EVENTS = 0x008 | 0x080 | 0x100
+
+    # The number of seconds between each check of the files when polling.
+    POLL_INTERVAL = 0.5
+
+    # The directory that generated files are written to.
+    attr_reader :dir
+
+    # The scope loaded from the spec files.
+    attr_reader :scope
+
+    # Loads a scope from the given spec files, without generating anything.
+    # Generated files are written to +dir+, which defaults to the current
+    # working directory.
+    def initialize(*filenames, dir: Dir.pwd)
+      @filenames = filenames
+      @dir = dir
+      @contents = {}
+      @mtimes = file_mtimes
+      @scope = Scope.load_files(*filenames)
+    end
+
+    # Generates all of the wrappers of the scope, returning the names of the
+    # files written.
+    #
+    # If a wrapper cannot be generated, the files of the other one are still
+    # written. The name of the wrapper and the error are then given to the
+    # provided block, or the error is raised if there is no block.
+    def generate(&block)
+      write_wrappers(block) do |contents|
+        CppWrapper.generate_spec_source_files(@scope, contents)
+      end
+    end
+
+    # Merges the given spec files into the scope again after they changed, and
+    # generates the files affected by them, returning the names of the files
+    # written. Errors generating a wrapper are handled as in +generate+.
+    def update(*filenames, &block)
+      reloaded = @scope.reload_files(*filenames)
+      changed_specs = reloaded.flat_map { |file| @scope.file_specs(file) }
+      specs = cpp_specs(affected_specs(changed_specs))
+
+      write_wrappers(block) do |contents|
+        specs.each do |spec|
+          CppWrapper.generate_spec_source_files(spec, contents,
+                                                support_files: false)
+        end
+        CppWrapper.new(@scope).generate_support_files(contents)
+      end
+    end
+
+    # Generates all of the wrappers of the scope, and then waits for the spec
+    # files to change and updates the generated files each time they do. This
+    # does not return, so is usually ended by an interrupt.
+    #
+    # A message describing each update is given to the provided block. If a
+    # changed file cannot be merged, the message gives the error and the
+    # scope is left as it was before the change. If a wrapper cannot be
+    # generated, a message gives the error and the files of the other wrapper
+    # are still written. All of the files are then generated again after the
+    # next change, so that none are left out of date.
+    def watch
+      failed = false
+      report = lambda do |language, error|
+        failed = true
+        yield "could not generate the #{language} wrapper: #{error.message}"
+      end
+
+      begin
+        yield "generated #{generate(&report).length} files"
+      rescue SystemCallError => e
+        failed = true
+        yield "could not write generated files: #{e.message}"
+      end
+
+      loop do
+        changed = wait_for_changes
+        next if changed.empty?
+
+        start = Process.clock_gettime(Process::CLOCK_MONOTONIC)
+        regenerate = failed
+        failed = false
+        begin
+          written = if regenerate
+                      @scope.reload_files(*changed)
+                      generate(&report)
+                    else
+                      update(*changed, &report)
+                    end
+        rescue WraptureError, JSON::ParserError, Psych::Exception,
+               SystemCallError => e
+          failed ||= regenerate
+          yield "could not merge #{changed.join(', ')}: #{e.message}"
+          next
+        end
+
+        elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+        yield "generated #{written.length} files in " \
+              "#{(elapsed * 1000).round} ms after changes to " \
+              "#{changed.join(', ')}"
+      end
+    end
+
+    private
+
+    # The classes and enums whose generated code may change when the given
+    # ones do. These are the specs themselves, along with the parents and
+    # children of the classes and the classes with functions using them.
+    def affected_specs(specs)
+      names = specs.map(&:name)
+      parents = specs.select { |spec| spec.is_a?(ClassSpec) && spec.child? }
+                     .map(&:parent_name)
+
+      related = @scope.classes.select do |class_spec|
+        names.include?(class_spec.parent_name) ||
+          parents.include?(class_spec.name) ||
+          class_spec.functions.any? do |func_spec|
+            types = func_spec.params.map(&:type) << func_spec.return_type
+            types.any? { |type| names.include?(type.base) }
+          end
+      end
+
+      @scope.select { |spec| specs.include?(spec) || related.include?(spec) }
+    end
+
+    # The specs that the C++ wrapper generates sources for to wrap the given
+    # specs, which replaces classes wrapped as a class template with their
+    # ClassFamilySpec.
+    def cpp_specs(specs)
+      families = @scope.class_families
+
+      specs.map do |spec|
+        families.find { |family| family.members.include?(spec) } || spec
+      end.uniq
+    end
+
+    # The modification times of each of the spec files.
+    def file_mtimes
+      @filenames.to_h do |filename|
+        [filename, File.exist?(filename) ? File.mtime(filename) : nil]
+      end
+    end
+
+    # Generates the Python module of the scope along with its setup script
+    # into the given sink.
+    def generate_python_files(sink)
+      PythonWrapper.generate_spec_source_files(@scope, sink)
+      PythonWrapper.new(@scope).generate_setuptools_files(sink)
+    end
+
+    # Sets up inotify watches on the directories of the spec files, returning
+    # the IO giving their events, or nil if inotify is not available. The
+    # directories are watched instead of the files themselves, since many
+    # editors save a file by replacing it.
+    def inotify
+      return @inotify if defined?(@inotify)
+
+      @inotify = begin
+        require 'fiddle'
+
+        libc = Fiddle.dlopen(nil)
+        init = Fiddle::Function.new(libc['inotify_init1'], [Fiddle::TYPE_INT],
+                                    Fiddle::TYPE_INT)
+        add_watch = Fiddle::Function.new(libc['inotify_add_watch'],
+                                         [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP,
+                                          Fiddle::TYPE_INT],
+                                         Fiddle::TYPE_INT)
+
+        fd = init.call(0)
+        @watch_dirs = {}
+        watched_dirs = @filenames.map do |filename|
+          File.dirname(File.expand_path(filename))
+        end
+        watched_dirs.uniq.each do |watched_dir|
+          wd = add_watch.call(fd, watched_dir, INOTIFY_EVENTS)
+          @watch_dirs[wd] = watched_dir
+        end
+
+        fd.negative? || @watch_dirs.key?(-1) ? nil : IO.for_fd(fd, 'rb')
+      rescue LoadError, Fiddle::DLError
+        nil
+      end
+    end
+
+    # Waits for inotify events and returns the spec files that they show
+    # changed.
+    def inotify_changes
+      events = inotify.readpartial(65_536)
+      paths = []
+
+      # each event is a struct inotify_event followed by the name of the file
+      until events.empty?
+        wd, _, _, length = events.unpack('iIII')
+        name = events.byteslice(16, length).delete("\0")
+        paths << File.join(@watch_dirs[wd], name)
+        events = events.byteslice((16 + length)..-1)
+      end
+
+      @filenames.select do |filename|
+        paths.include?(File.expand_path(filename))
+      end
+    end
+
+    # Waits for the polling interval and returns the spec files that changed
+    # since they were last polled.
+    def poll_changes
+      sleep POLL_INTERVAL
+      mtimes = file_mtimes
+      changed = @filenames.reject do |filename|
+        mtimes[filename] == @mtimes[filename]
+      end
+      @mtimes = mtimes
+
+      changed
+    end
+
+    # Waits for changes to the spec files, returning the names of the files
+    # that changed. This may return an empty list if an event that did not
+    # change a spec file was seen.
+    def wait_for_changes
+      inotify ? inotify_changes : poll_changes
+    end
+
+    # Writes the C++ files that the given block generates into the sink it is
+    # given, and then the files of the Python wrapper of the scope, returning
+    # the names of the files written.
+    #
+    # Each wrapper is generated and written on its own. If one cannot be
+    # generated, its name and the error are given to +handler+, or the first
+    # such error is raised once the other wrapper is written if +handler+ is
+    # nil.
+    def write_wrappers(handler, &cpp_files)
+      wrappers = { 'C++' => cpp_files,
+                   'Python' => method(:generate_python_files) }
+      errors = []
+
+      written = wrappers.each_with_object([]) do |(language, files), names|
+        contents = {}
+        files.call(contents)
+        names.concat(write_changed(contents))
+      rescue WraptureError => e
+        errors << [language, e]
+      end
+
+      raise errors.first.last if handler.nil? && !errors.empty?
+
+      errors.each { |language, error| handler.call(language, error) }
+      written
+    end
+
+    # Writes the files of the given contents whose contents are different from
+    # when they were last written, returning the names of the files written.
+    def write_changed(contents)
+      contents.each_with_object([]) do |(filename, content), written|
+        next if @contents[filename] == content
+
+        File.write(File.join(@dir, filename), content)
+        @contents[filename] = content
+        written << filename
+      end
+    end
+  end
+end
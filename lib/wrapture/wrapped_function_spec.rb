@@ -102,11 +102,15 @@ module Wrapture
       return if @error_rules.empty?
 
       checks = @error_rules.map { |rule| rule.check(return_val: return_val) }
-      yield "if( #{checks.join(' && ')} ){"
-      yield "  #{@error_action.take};"
+      yield "if #{UNLIKELY_MACRO}( #{checks.join(' && ')} ){"
+      yield "  #{@error_action.call};"
       yield '}'
     end
 
+    # The ActionSpec taken when the error check fails, or nil if there is no
+    # error check.
+    attr_reader :error_action
+
     # True if the wrapped function has an error check associated with it.
     def error_check?
       !@error_rules.empty?
@@ -126,6 +130,11 @@ module Wrapture
       @spec['libraries'].dup
     end
 
+    # True if the given value is supplied as one of the parameters.
+    def param_value?(value)
+      @spec['params'].any? { |param_spec| param_spec['value'] == value }
+    end
+
     # A TypeSpec describing the type of the return value.
     #
     # Changed in release 0.4.2 to return a TypeSpec instead of a String.
@@ -6,3 +6,8 @@ def load_fixture(name)
   fixture_path = File.expand_path('fixtures', __dir__)
   YAML.load_file(File.join(fixture_path, "#{name}.yml"))
 end
+
+def fixture_file(name, format: 'yml')
+  fixture_dir = format == 'json' ? 'fixtures/json' : 'fixtures'
+  File.join(File.expand_path(fixture_dir, __dir__), "#{name}.#{format}")
+end
@@ -85,6 +85,28 @@ def file_contains_match(filename, regex)
   false
 end
 
+def get_forward_declared_classes(filename)
+  classes = []
+  File.open(filename).each do |line|
+    if (m = line.match(/^\s+class (\w+);$/))
+      classes << m[1]
+    end
+  end
+
+  classes
+end
+
+def get_forward_declared_structs(filename)
+  structs = []
+  File.open(filename).each do |line|
+    if (m = line.match(/^struct (\w+);$/))
+      structs << m[1]
+    end
+  end
+
+  structs
+end
+
 def get_include_list(filename)
   includes = []
   File.open(filename).each do |line|
@@ -96,6 +118,17 @@ def get_include_list(filename)
   includes
 end
 
+def pointer_structs(spec)
+  types = spec['functions'].flat_map do |func_spec|
+    params = func_spec.fetch('params', []).map { |param| param['type'] }
+    params << func_spec.dig('return', 'type')
+  end
+
+  structs = types.map { |type| type.to_s[/\Astruct (\w+) ?\*\z/, 1] }
+  structs << spec.dig('equivalent-struct', 'name') unless spec.key?('parent')
+  structs.compact.uniq
+end
+
 def refute_keywords_found(filename)
   File.open(filename) do |file|
     file.each do |line|
@@ -121,12 +154,27 @@ end
 
 def validate_declaration_file(spec)
   filename = "#{spec['name']}.hpp"
-  class_includes = Wrapture::ClassSpec.normalize_spec_hash(spec)['includes']
+  normalized = Wrapture::ClassSpec.normalize_spec_hash(spec)
 
   includes = get_include_list filename
+  classes = get_forward_declared_classes filename
+  structs = get_forward_declared_structs filename
+
+  # the headers of the wrapped library are only left out if the structs that
+  # the declaration uses are forward declared instead
+  if structs.empty?
+    normalized['includes'].each do |class_include|
+      assert_includes(includes, class_include)
+    end
+  else
+    pointer_structs(normalized).each do |struct_name|
+      assert_includes(structs, struct_name)
+    end
+  end
 
-  class_includes.each do |class_include|
-    assert_includes(includes, class_include)
+  # forward declared classes are included by the definition instead
+  classes.each do |class_name|
+    refute_includes(includes, "#{class_name}.hpp")
   end
 
   validate_indentation filename
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+
+# SPDX-License-Identifier: Apache-2.0
+
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+# Imports the named module in several subinterpreters at once, each from its
+# own thread, and touches every attribute of it.
+
+import sys
+import threading
+
+try:
+  import _interpreters as interpreters
+except ImportError:
+  import _xxsubinterpreters as interpreters
+
+module_name = sys.argv[1]
+script = ('import {0}\n'
+          'for name in dir({0}):\n'
+          '  getattr({0}, name)\n').format(module_name)
+errors = []
+
+def import_module():
+  interp = interpreters.create()
+  try:
+    # older versions raise the error, newer ones return it
+    error = interpreters.run_string(interp, script)
+    if error:
+      errors.append(error)
+  except Exception as e:
+    errors.append(e)
+  finally:
+    interpreters.destroy(interp)
+
+__import__(module_name)
+
+# modules built with NumPy ufuncs cannot be loaded in subinterpreters
+if 'numpy' in sys.modules:
+  print('{} uses NumPy, which does not support subinterpreters'
+        .format(module_name))
+  sys.exit(0)
+
+threads = [threading.Thread(target=import_module) for _ in range(4)]
+for thread in threads:
+  thread.start()
+for thread in threads:
+  thread.join()
+
+if errors:
+  for error in errors:
+    print(error, file=sys.stderr)
+  sys.exit(1)
+
+print('{} imported in {} subinterpreters'.format(module_name, len(threads)))
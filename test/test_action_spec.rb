@@ -37,6 +37,19 @@ class ActionSpecTest < Minitest::Test
     assert_includes(action, 'throw NewCustomException')
   end
 
+  def test_cold_helper
+    test_spec = load_fixture('basic_action')
+
+    spec = Wrapture::ActionSpec.new(test_spec)
+    helper = []
+    spec.define_helper { |line| helper << line }
+
+    assert_equal('ThrowNewCustomException', spec.helper_name)
+    assert_match(/\AThrowNewCustomException\( .* \)\z/, spec.call)
+    assert_includes(helper, '[[noreturn]] [[gnu::cold]] [[gnu::noinline]]')
+    assert_includes(helper.join("\n"), 'throw NewCustomException( std::forward')
+  end
+
   def test_exception_without_params
     test_spec = load_fixture('exception_action_without_params')
 
@@ -0,0 +1,99 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require 'helper'
+
+require 'fixture'
+require 'minitest/autorun'
+require 'wrapture'
+
+class AsyncFunctionTest < Minitest::Test
+  def test_async_function
+    test_spec = load_fixture('async_functions')
+
+    scope = Wrapture::Scope.new(test_spec)
+
+    generated_files = Wrapture::CppWrapper.write_spec_source_files(scope)
+    validate_wrapper_results(test_spec, generated_files)
+
+    assert_equal(1, generated_files.count('WorkerPool.hpp'))
+    assert(file_contains_match('WorkerPool.hpp', 'class WorkerPool'))
+    assert(file_contains_match('Connection.hpp', '#include <WorkerPool.hpp>'))
+    assert(file_contains_match('Connection.hpp',
+                               'std::future<int> FetchFuture'))
+    assert(file_contains_match('Connection.hpp', 'Awaitable<void> FlushAsync'))
+    assert(file_contains_match('Connection.hpp',
+                               'static std::future<int> PingFuture'))
+    refute(file_contains_match('Connection.hpp', 'CloseFuture'))
+    assert(file_contains_match('Connection.cpp',
+                               /\[\]\(\) \{ return Ping\(\); \}/))
+    assert(file_contains_match('Connection.cpp', /\[this\]\(\) \{ return/))
+    assert(file_contains_match('Connection.hpp',
+                               'outlive the returned future or awaitable'))
+
+    File.delete(*generated_files)
+  end
+
+  def test_async_key
+    test_spec = load_fixture('async_functions')
+
+    class_spec = Wrapture::ClassSpec.new(test_spec['classes'].first)
+    async_names = class_spec.functions.select(&:async?).map(&:name)
+
+    assert_equal(%w[Fetch Flush Ping], async_names)
+  end
+
+  def test_shared_instance_captured_by_copy
+    test_spec = load_fixture('async_functions')
+    class_spec = test_spec['classes'].first
+    class_spec['ownership'] = 'shared'
+    class_spec['type'] = 'pointer'
+    class_spec['destructor'] = {
+      'wrapped-function' => {
+        'name' => 'connection_close',
+        'params' => [{ 'name' => 'equivalent-struct-pointer' }]
+      }
+    }
+
+    contents = {}
+    Wrapture::CppWrapper.generate_spec_source_files(
+      Wrapture::Scope.new(test_spec), contents
+    )
+
+    assert_includes(contents['Connection.cpp'],
+                    '[self = *this]() mutable { return self.Flush(); }')
+    assert_includes(contents['Connection.hpp'], 'captured as a copy')
+  end
+
+  def test_cmake_links_threads
+    scope = Wrapture::Scope.new(load_fixture('async_functions'))
+    wrapper = Wrapture::CppWrapper.new(scope)
+
+    contents = {}
+    wrapper.generate_cmake_files(contents)
+
+    assert_includes(contents['CMakeLists.txt'], 'find_package(Threads')
+    assert_includes(wrapper.source_files, 'WorkerPool.hpp')
+  end
+
+  def test_no_worker_pool_without_async
+    scope = Wrapture::Scope.new(load_fixture('scope_with_enum'))
+
+    refute_includes(Wrapture::CppWrapper.source_files(scope), 'WorkerPool.hpp')
+  end
+end
@@ -60,6 +60,20 @@ class ClassSpecTest < Minitest::Test
     File.delete(*generated_files)
   end
 
+  def test_error_check_helpers
+    test_spec = load_fixture('async_functions')['classes'].first
+    spec = Wrapture::ClassSpec.new(test_spec)
+    contents = {}
+    Wrapture::CppWrapper.new(spec).generate_definition_file(contents)
+    source = contents['Connection.cpp']
+
+    assert_includes(source, '#define WRAPTURE_UNLIKELY( condition )')
+    assert_includes(source, "  namespace {\n    template<typename... Args>")
+    assert_includes(source, 'void ThrowFetchException( Args&&... args ) {')
+    assert_includes(source, "if WRAPTURE_UNLIKELY( return_val < 0 ){\n" \
+                            '      ThrowFetchException( return_val );')
+  end
+
   def test_future_spec_version
     test_spec = load_fixture('future_version_class')
 
@@ -76,6 +90,12 @@ class ClassSpecTest < Minitest::Test
     classes = Wrapture::CppWrapper.write_spec_source_files(spec)
     validate_wrapper_results(test_spec, classes)
 
+    # the struct is held by value, so its full definition is needed
+    includes = get_include_list('BasicClass.hpp')
+
+    assert_includes(includes, 'class_include.h')
+    assert_includes(includes, 'folder/include_file_1.h')
+
     File.delete(*classes)
   end
 
@@ -252,6 +272,126 @@ class ClassSpecTest < Minitest::Test
     File.delete(*classes)
   end
 
+  def test_in_place_class
+    test_spec = load_fixture('in_place_class')
+    class_spec = Wrapture::ClassSpec.new(test_spec)
+    contents = {}
+    Wrapture::CppWrapper.new(class_spec).generate_source_files(contents)
+    header = contents['InPlaceClass.hpp']
+    source = contents['InPlaceClass.cpp']
+
+    assert_predicate(class_spec, :in_place?)
+    refute_predicate(class_spec, :pointer_wrapper?)
+    assert_includes(header, 'InPlaceClass( const char *new_name );')
+    assert_includes(header, 'InPlaceClass( const InPlaceClass& ) = delete;')
+    assert_includes(header, 'struct wrapped_struct equivalent;')
+    refute_includes(header, 'InPlaceClass( struct wrapped_struct *')
+    assert_includes(source, 'return_val = init_thing( &this->equivalent, ' \
+                            'new_name );')
+    assert_includes(source, 'cleanup_thing( &this->equivalent );')
+
+    scope = class_spec.scope
+    contents = {}
+    Wrapture::PythonWrapper.new(scope).generate_source_files(contents)
+
+    assert_includes(contents["#{scope.name}.c"],
+                    'init_thing( &(self->equivalent), new_name );')
+  end
+
+  def test_serializable_class
+    test_spec = load_fixture('serializable_class')
+    class_spec = Wrapture::ClassSpec.new(test_spec)
+    contents = {}
+    Wrapture::CppWrapper.new(class_spec).generate_source_files(contents)
+    header = contents['SerializableClass.hpp']
+    source = contents['SerializableClass.cpp']
+    fingerprint = class_spec.struct.layout_fingerprint
+
+    assert_predicate(class_spec, :serializable?)
+    assert_match(/\A0x\h{16}ULL\z/, fingerprint)
+    assert_includes(header, 'static constexpr std::uint64_t ' \
+                            "layout_fingerprint = #{fingerprint};")
+    assert_includes(header, 'std::vector<unsigned char> to_bytes( void ) ' \
+                            'const;')
+    assert_includes(source, 'SerializableClass::from_bytes( const unsigned ' \
+                            'char *bytes, std::size_t length ) {')
+    assert_includes(source, 'throw std::invalid_argument(')
+
+    scope = class_spec.scope
+    contents = {}
+    Wrapture::PythonWrapper.new(scope).generate_source_files(contents)
+    module_source = contents["#{scope.name}.c"]
+
+    assert_includes(module_source, '{ .ml_name = "__reduce_ex__",')
+    assert_includes(module_source, 'PyPickleBuffer_FromObject(')
+    assert_includes(module_source, '{ Py_bf_getbuffer, ' \
+                                   'serializable_class_getbuffer },')
+  end
+
+  def test_sequence_range
+    test_spec = load_fixture('sequence_class')['classes'].first
+    spec = Wrapture::ClassSpec.new(test_spec)
+    contents = {}
+    Wrapture::CppWrapper.new(spec).generate_declaration_file(contents)
+    header = contents['Playlist.hpp']
+
+    assert_includes(header, '#include <iterator>')
+    assert_includes(header, '#include <playlist.h>')
+    refute_includes(header, 'struct playlist;')
+    assert_includes(header, "    class Iterator {\n    public:\n" \
+                            '      using iterator_category = ' \
+                            'std::random_access_iterator_tag;')
+    assert_includes(header, '      using value_type = double;')
+    assert_includes(header, 'return ( *this->owner )[static_cast<size_t>( ' \
+                            'this->index )];')
+    assert_includes(header, '      auto count = ( size_t )( ' \
+                            'get_track_count( this->equivalent ) );')
+    assert_includes(header, "    double operator[]( size_t track ) const {\n" \
+                            '      return ( double )( ' \
+                            'get_track_length( this->equivalent, track ) );')
+    assert_includes(header, '    Iterator end( void ) const {')
+  end
+
+  def test_sequence_range_of_struct
+    test_spec = load_fixture('sequence_class')['classes'].first
+    test_spec.delete('constructors')
+    test_spec.delete('destructor')
+    test_spec['type'] = 'struct'
+    test_spec['functions'].first['pure'] = true
+    contents = {}
+    Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(test_spec))
+                        .generate_declaration_file(contents)
+    header = contents['Playlist.hpp']
+
+    assert_includes(header, 'get_track_count( const_cast<struct playlist *>( ' \
+                            '&this->equivalent ) )')
+    assert_includes(header, 'return const_cast<Playlist *>( this )->' \
+                            'GetTrackLength( track );')
+    assert_includes(header, '    std::size_t size( void ) const {')
+    assert_includes(header, '    Iterator begin( void ) const {')
+  end
+
+  def test_side_effect_free_functions
+    test_spec = load_fixture('side_effect_free_class')
+    contents = {}
+    Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(test_spec))
+                        .generate_source_files(contents)
+    header = contents['Gauge.hpp']
+    source = contents['Gauge.cpp']
+
+    assert_includes(header, '#define WRAPTURE_PURE [[gnu::pure]]')
+    assert_includes(header, 'WRAPTURE_NODISCARD WRAPTURE_PURE double ' \
+                            'GetReading( void ) const;')
+    assert_includes(header, 'WRAPTURE_NODISCARD bool IsCalibrated( void ) ' \
+                            'const;')
+    assert_includes(header, 'WRAPTURE_NODISCARD WRAPTURE_CONST static ' \
+                            'double ToMetric( double reading );')
+    assert_includes(source, 'double Gauge::GetReading( void ) const {')
+    assert_includes(source, 'get_gauge_reading( const_cast<struct gauge *>' \
+                            '( &this->equivalent ) )')
+    assert_includes(source, 'double Gauge::ToMetric( double reading ) {')
+  end
+
   def test_versioned_class
     test_spec = load_fixture('versioned_class')
 
@@ -56,14 +56,12 @@ class FunctionSpecTest < Minitest::Test
 
     spec = Wrapture::FunctionSpec.new(test_spec)
 
-    throw_code = 'throw CodeException( return_val )'
-    Wrapture::CppWrapper.define_spec(spec) do |line|
-      next if line.nil?
-
-      code = line.strip
+    lines = Wrapture::CppWrapper.define_spec(spec, &block_collector)
+    code = lines.map(&:strip)
 
-      assert_includes(code, throw_code) if code.start_with?('throw')
-    end
+    assert_includes(code, 'if WRAPTURE_UNLIKELY( return_val != 0 ){')
+    assert_includes(code, 'ThrowCodeException( return_val );')
+    refute(code.any? { |line| line.start_with?('throw') })
   end
 
   def test_exception_without_return_val
@@ -133,6 +131,23 @@ class FunctionSpecTest < Minitest::Test
     end
   end
 
+  def test_invalid_return_ownership
+    test_spec = load_fixture('basic_function')
+    test_spec['return'] = { 'type' => 'Thing *', 'ownership' => 'shared' }
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::FunctionSpec.new(test_spec)
+    end
+
+    test_spec['return'] = { 'type' => 'Thing *',
+                            'overloaded' => true,
+                            'ownership' => 'value' }
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::FunctionSpec.new(test_spec)
+    end
+  end
+
   def test_matching_return_types
     test_spec = load_fixture('no_cast_function')
 
@@ -206,6 +221,21 @@ class FunctionSpecTest < Minitest::Test
     assert_includes(error.message, 'only param')
   end
 
+  def test_side_effect_free_without_return
+    test_spec = load_fixture('basic_function')
+    test_spec['pure'] = true
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::FunctionSpec.new(test_spec)
+    end
+
+    test_spec['return'] = { 'type' => 'int' }
+    spec = Wrapture::FunctionSpec.new(test_spec)
+
+    assert(spec.side_effect_free?)
+    refute(spec.const?)
+  end
+
   def test_undefinable
     test_spec = load_fixture('undefinable_function')
 
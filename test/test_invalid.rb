@@ -31,6 +31,30 @@ class InvalidTest < Minitest::Test
     end
   end
 
+  def test_const_member_function
+    test_spec = load_fixture('invalid/const_member_function')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
+  def test_const_pointer_param
+    test_spec = load_fixture('invalid/const_pointer_param')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
+  def test_in_place_pointer_class
+    test_spec = load_fixture('invalid/in_place_pointer_class')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
   def test_invalid_virtual_key
     test_spec = load_fixture('invalid/invalid_virtual_key')
 
@@ -55,6 +79,14 @@ class InvalidTest < Minitest::Test
     end
   end
 
+  def test_non_static_ufunc
+    test_spec = load_fixture('invalid/non_static_ufunc')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
   def test_rule_missing_condition
     test_spec = load_fixture('invalid/rule_missing_condition')
 
@@ -79,6 +111,38 @@ class InvalidTest < Minitest::Test
     end
   end
 
+  def test_sequence_with_static_item
+    test_spec = load_fixture('invalid/sequence_with_static_item')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
+  def test_serializable_pointer_class
+    test_spec = load_fixture('invalid/serializable_pointer_class')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
+  def test_shared_struct_class
+    test_spec = load_fixture('invalid/shared_struct_class')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
+  def test_typemap_without_functions
+    test_spec = load_fixture('invalid/typemap_without_functions')
+
+    assert_raises(Wrapture::MissingSpecKey) do
+      Wrapture::Scope.new(test_spec)
+    end
+  end
+
   def test_use_template_as_array
     scope_spec = load_fixture('invalid/use_template_as_array')
 
@@ -39,6 +39,10 @@ class OverloadedStructTest < Minitest::Test
     assert(file_contains_match(def_file, 'Parent \*Parent::newParent'))
     assert(file_contains_match(def_file, 'Parent \*Parent::OverloadedType'))
     assert(file_contains_match(def_file, 'return newParent \('))
+    assert(file_contains_match('Parent.hpp', 'class WRAPTURE_EXPORT Parent {'))
+    assert(file_contains_match('ChildOne.hpp',
+                               'class WRAPTURE_EXPORT ChildOne final : ' \
+                               'public Parent {'))
 
     includes = get_include_list(def_file)
 
@@ -47,4 +51,83 @@ class OverloadedStructTest < Minitest::Test
 
     File.delete(*generated_files)
   end
+
+  def test_return_ownership
+    test_spec = load_fixture('overloaded_struct')
+    functions = test_spec['classes'].first['functions']
+    functions.first['return']['ownership'] = 'unique_ptr'
+
+    scope = Wrapture::Scope.new(test_spec)
+    generated_files = Wrapture::CppWrapper.write_spec_source_files(scope)
+    validate_wrapper_results(test_spec, generated_files)
+
+    def_file = 'Parent.cpp'
+
+    assert_includes(get_include_list('Parent.hpp'), 'memory')
+    assert(file_contains_match('Parent.hpp',
+                               'std::unique_ptr<Parent> OverloadedType'))
+    owned_call = 'return std::unique_ptr<Parent>\\( newParent \\('
+
+    assert(file_contains_match(def_file, owned_call))
+
+    File.delete(*generated_files)
+  end
+
+  def test_return_ownership_value_of_overloaded_class
+    test_spec = load_fixture('overloaded_struct')
+    functions = test_spec['classes'].first['functions']
+    functions << { 'name' => 'Copy',
+                   'return' => { 'type' => 'Parent *', 'ownership' => 'value' },
+                   'wrapped-function' => {
+                     'name' => 'copy_overloaded_struct',
+                     'params' => [{ 'value' => 'equivalent-struct-pointer' }],
+                     'return' => { 'type' => 'equivalent-struct-pointer' }
+                   } }
+
+    scope = Wrapture::Scope.new(test_spec)
+
+    # a copy of Parent would lose the type of the child that it was made from
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::CppWrapper.generate_spec_source_files(scope, {})
+    end
+  end
+
+  def test_static_dispatch
+    test_spec = load_fixture('overloaded_struct')
+    parent_spec, child_spec = test_spec['classes']
+    parent_spec['static-dispatch'] = true
+    parent_spec['functions'] << { 'name' => 'Describe',
+                                  'virtual' => true,
+                                  'wrapped-function' => {
+                                    'name' => 'describe_parent',
+                                    'params' => [{
+                                      'value' => 'equivalent-struct-pointer'
+                                    }]
+                                  } }
+    child_spec['functions'] = [{ 'name' => 'Describe',
+                                 'wrapped-function' => {
+                                   'name' => 'describe_child_one',
+                                   'params' => [{
+                                     'value' => 'equivalent-struct-pointer'
+                                   }]
+                                 } }]
+
+    scope = Wrapture::Scope.new(test_spec)
+    generated_files = Wrapture::CppWrapper.write_spec_source_files(scope)
+    validate_wrapper_results(test_spec, generated_files)
+
+    def_file = 'Parent.cpp'
+
+    refute(file_contains_match('Parent.hpp', 'virtual'))
+    assert(file_contains_match(def_file, 'return new Parent\( equivalent \);'))
+    refute(file_contains_match(def_file, 'new ChildOne'))
+
+    dispatch = 'if\( \( &this->equivalent \)->code == 1 \)\{'
+
+    assert(file_contains_match(def_file, dispatch))
+    assert(file_contains_match(def_file, 'describe_child_one\( '))
+    assert(file_contains_match(def_file, 'describe_parent\( '))
+
+    File.delete(*generated_files)
+  end
 end
@@ -72,6 +72,22 @@ class ClassSpecTest < Minitest::Test
     File.delete(*classes)
   end
 
+  def test_pointer_class_forward_declaration
+    test_spec = load_fixture('pointer_class')
+
+    spec = Wrapture::ClassSpec.new(test_spec)
+
+    classes = Wrapture::CppWrapper.write_spec_source_files(spec)
+    validate_wrapper_results(test_spec, classes)
+
+    assert(file_contains_match('PointerWrappingClass.hpp',
+                               /^struct wrapped_struct;$/))
+    refute_includes(get_include_list('PointerWrappingClass.hpp'), 'wrapme.h')
+    assert_includes(get_include_list('PointerWrappingClass.cpp'), 'wrapme.h')
+
+    File.delete(*classes)
+  end
+
   def test_pointer_class_and_child
     test_spec = load_fixture('pointer_class_and_child')
 
@@ -142,4 +158,65 @@ class ClassSpecTest < Minitest::Test
 
     File.delete(*classes)
   end
+
+  def test_shared_pointer_class
+    test_spec = load_fixture('shared_pointer_class')
+    contents = {}
+    Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(test_spec))
+                        .generate_source_files(contents)
+    header = contents['SharedPointerClass.hpp']
+    source = contents['SharedPointerClass.cpp']
+
+    assert_includes(header, '#include <atomic>')
+    assert_includes(header, 'SharedPointerClass( const SharedPointerClass& ' \
+                            'other );')
+    assert_includes(header, "  private:\n    mutable std::atomic<" \
+                            'std::atomic<long> *> references{ nullptr };')
+    refute_includes(header, 'new std::atomic')
+    assert_includes(source, 'fetch_sub( 1, std::memory_order_acq_rel ) ' \
+                            "!= 1 ) {\n        return;\n      }")
+    assert_includes(source, 'SharedPointerClass::SharedPointerClass( ' \
+                            'SharedPointerClass&& other ) noexcept')
+    assert_includes(source, 'references( other.AddReference() ) {}')
+    assert_includes(source, 'this->references.compare_exchange_strong( ' \
+                            'references, created,')
+
+    test_spec['functions'] = [
+      { 'name' => 'Share',
+        'return' => { 'type' => 'SharedPointerClass *',
+                      'ownership' => 'value' },
+        'wrapped-function' => {
+          'name' => 'share_a_struct',
+          'params' => [{ 'value' => 'equivalent-struct-pointer' }],
+          'return' => { 'type' => 'equivalent-struct-pointer' }
+        } }
+    ]
+    contents = {}
+    Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(test_spec))
+                        .generate_source_files(contents)
+
+    assert_includes(contents['SharedPointerClass.hpp'],
+                    'SharedPointerClass Share( void );')
+    assert_includes(contents['SharedPointerClass.cpp'],
+                    'return SharedPointerClass( share_a_struct(')
+
+    # copies of a raw pointer wrapper would destroy the same struct
+    raw_spec = test_spec.merge('ownership' => 'raw')
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(raw_spec))
+                          .generate_source_files({})
+    end
+
+    test_spec['ownership'] = 'shared-nonatomic'
+    contents = {}
+    Wrapture::CppWrapper.new(Wrapture::ClassSpec.new(test_spec))
+                        .generate_source_files(contents)
+
+    refute_includes(contents['SharedPointerClass.hpp'], 'atomic')
+    assert_includes(contents['SharedPointerClass.cpp'],
+                    '--*references != 0')
+    assert_includes(contents['SharedPointerClass.cpp'],
+                    'this->references = new long( 1 );')
+  end
 end
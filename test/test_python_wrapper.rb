@@ -0,0 +1,340 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require 'helper'
+
+require 'fixture'
+require 'minitest/autorun'
+require 'wrapture'
+
+def generate_python_module(fixture_name)
+  scope = Wrapture::Scope.new(load_fixture(fixture_name))
+  contents = {}
+  Wrapture::PythonWrapper.generate_spec_source_files(scope, contents)
+
+  contents["#{scope.name}.c"]
+end
+
+class PythonWrapperTest < Minitest::Test
+  def test_async_method
+    source = generate_python_module('async_functions')
+
+    assert_includes(source, '#include <pthread.h>')
+    assert_includes(source, 'if( async_pool_init() < 0 ){')
+    assert_includes(source, '.ml_name = "FetchAsync"')
+    assert_includes(source, '.ml_name = "PingAsync"')
+    assert_includes(source, "( PyCFunction ) connection_PingAsync,\n" \
+                            '    .ml_flags = METH_NOARGS | METH_CLASS,')
+    refute_includes(source, 'CloseAsync')
+
+    # the process-wide pool keeps the module out of other interpreters
+    assert_includes(source, 'Py_MOD_MULTIPLE_INTERPRETERS_NOT_SUPPORTED')
+
+    # the job runs the wrapped call and converts with the return statement
+    run_start = source.index('connection_FetchAsync_run( async_job *base ) {')
+    run_end = source.index("\n}\n", run_start)
+
+    assert_includes(source[run_start..run_end], 'connection_fetch(')
+
+    result_start = source.index('connection_FetchAsync_result(')
+    result_end = source.index("\n}\n", result_start)
+
+    assert_includes(source[result_start..result_end],
+                    'return PyLong_FromLong(return_val);')
+  end
+
+  def test_constants_on_type
+    scope = Wrapture::Scope.new('classes' => [load_fixture('constant_class')])
+    contents = {}
+    Wrapture::PythonWrapper.generate_spec_source_files(scope, contents)
+    source = contents["#{scope.name}.c"]
+
+    struct_start = source.index('typedef struct {')
+    struct_end = source.index('} class_with_constant_type_struct;')
+
+    refute_includes(source[struct_start..struct_end], 'test_constant')
+    refute_includes(source, 'self->test_constant')
+    assert_includes(source, 'PyDict_SetItemString( dict, "TEST_CONSTANT"')
+    add_constants = 'if( class_with_constant_add_constants( ' \
+                    'state->class_with_constant_type_object ) < 0 ){'
+
+    assert_includes(source, add_constants)
+  end
+
+  def test_module_state
+    source = generate_python_module('overloaded_struct')
+
+    assert_includes(source, "typedef struct {\n" \
+                            "  PyTypeObject *parent_type_object;\n" \
+                            "  PyTypeObject *child_one_type_object;\n")
+    assert_includes(source, 'PyType_GetModuleByDef( type, ' \
+                            '&wrapture_test_module )')
+    assert_includes(source, 'return new_Parent( state, return_val );')
+    assert_includes(source, 'type = state->child_one_type_object;')
+    assert_includes(source, 'Py_CLEAR( state->child_two_type_object );')
+
+    # parents are created first and given as the base of their children
+    parent_start = source.index('state->parent_type_object = ')
+    child_start = source.index('state->child_one_type_object = ')
+
+    assert_operator(parent_start, :<, child_start)
+    assert_includes(source, '&child_one_type_spec, ' \
+                            '( PyObject * ) state->parent_type_object );')
+    assert_includes(source,
+                    '.flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,')
+  end
+
+  def test_multi_phase_init
+    source = generate_python_module('overloaded_functions')
+
+    refute_includes(source, 'PyModule_Create')
+    refute_includes(source, 'static PyTypeObject')
+    assert_includes(source, 'return PyModuleDef_Init( &wrapture_test_module );')
+    assert_includes(source, '{ Py_mod_exec, wrapture_test_exec },')
+    assert_includes(source, '{ Py_mod_multiple_interpreters, ' \
+                            'Py_MOD_PER_INTERPRETER_GIL_SUPPORTED },')
+    assert_includes(source, '{ Py_mod_gil, Py_MOD_GIL_USED },')
+    assert_includes(source, '.m_size = sizeof( wrapture_test_state ),')
+    assert_includes(source, 'PyType_FromModuleAndSpec( m, ' \
+                            '&counter_type_spec, NULL );')
+
+    # nothing needs the module state, so it is never looked up
+    refute_includes(source, 'wrapture_test_get_state')
+  end
+
+  def test_no_async_pool
+    source = generate_python_module('overloaded_functions')
+
+    refute_includes(source, 'pthread')
+    refute_includes(source, 'async_pool')
+  end
+
+  def test_overload_dispatch
+    source = generate_python_module('overloaded_functions')
+
+    assert_includes(source, 'switch( PyTuple_GET_SIZE( args ) ) {')
+    assert_includes(source, 'PyFloat_Check( PyTuple_GET_ITEM( args, 0 ) )')
+    assert_includes(source, 'PyLong_Check( PyTuple_GET_ITEM( args, 0 ) )')
+    assert_includes(source, 'PyExc_TypeError')
+    assert_includes(source, 'return raise_overload_mismatch( "')
+    assert_includes(source, 'Add(double amount), Add(int amount), Add()')
+    refute_includes(source, 'TODO')
+
+    # the exact int check must come before the loose double check
+    exact_int = source.index('PyLong_Check( PyTuple_GET_ITEM( args, 0 ) )')
+    loose_double = source.index('PyNumber_Check( PyTuple_GET_ITEM( args, 0 ) )')
+
+    assert_operator(exact_int, :<, loose_double)
+
+    # the group wrapper parses nothing itself
+    group_start = source.index("static PyObject *\ncounter_Add(")
+    group_end = source.index("\n}\n", group_start)
+
+    refute_includes(source[group_start..group_end], 'PyArg_ParseTuple')
+  end
+
+  def test_overloaded_method_registration
+    source = generate_python_module('overloaded_functions')
+
+    assert_equal(1, source.scan('.ml_name = "Add"').length)
+    assert_includes(source, ".ml_meth = ( PyCFunction ) counter_Add,\n" \
+                            '    .ml_flags = METH_VARARGS,')
+  end
+
+  def test_sequence
+    source = generate_python_module('sequence_class')
+
+    assert_includes(source, '{ Py_sq_length, playlist_sq_length },')
+    assert_includes(source, '{ Py_sq_item, playlist_sq_item },')
+    assert_includes(source, '{ Py_tp_iter, playlist_iter },')
+    assert_includes(source, '.ml_name = "to_list",')
+    assert_includes(source, 'PyTypeObject *playlist_iterator_type_object;')
+    assert_includes(source, 'Py_CLEAR( state->playlist_iterator_type_object );')
+    assert_includes(source, '&playlist_iterator_type_spec, NULL );')
+
+    # items are fetched with a direct call instead of through the method
+    get_start = source.index('playlist_sequence_get( playlist_type_struct')
+    get_end = source.index("\n}\n", get_start)
+    get = source[get_start..get_end]
+
+    assert_includes(get, 'track = ( size_t ) index;')
+    assert_includes(get, 'get_track_length( self->equivalent, track );')
+    assert_includes(get, 'return PyFloat_FromDouble(return_val);')
+    refute_includes(get, 'PyArg_ParseTuple')
+  end
+
+  def test_setup_build_options
+    spec = load_fixture('overloaded_functions')
+    scope = Wrapture::Scope.new(spec)
+    contents = {}
+    Wrapture::PythonWrapper.new(scope).generate_setuptools_files(contents)
+
+    assert_includes(contents['setup.py'], 'extra_compile_args = [],')
+
+    spec['build'] = { 'optimize' => true, 'sources' => 'counter.c',
+                      'include-dirs' => 'include' }
+    scope = Wrapture::Scope.new(spec)
+    Wrapture::PythonWrapper.new(scope).generate_setuptools_files(contents)
+    setup = contents['setup.py']
+
+    assert_includes(setup, "sources = ['wrapture_test.c', 'counter.c'],")
+    assert_includes(setup, "include_dirs = ['.', 'include'],")
+    assert_includes(setup, "extra_compile_args = ['-O3', '-flto', " \
+                           "'-fvisibility=hidden'],")
+    assert_includes(setup, 'libraries = [],')
+  end
+
+  def test_static_setup
+    spec = load_fixture('overloaded_functions')
+    spec['build'] = { 'static' => true }
+    scope = Wrapture::Scope.new(spec)
+    contents = {}
+    Wrapture::PythonWrapper.new(scope).generate_setuptools_files(contents)
+    setup = contents['setup.py']
+
+    assert_includes(setup, 'libraries = [],')
+    assert_includes(setup, "extra_link_args = ['-Wl,-Bstatic', '-lcounter', " \
+                           "'-Wl,-Bdynamic'])")
+  end
+
+  def test_lazy_types_scope
+    spec = load_fixture('overloaded_struct')
+    spec['lazy-types'] = true
+    scope = Wrapture::Scope.new(spec)
+    contents = {}
+    Wrapture::PythonWrapper.generate_spec_source_files(scope, contents)
+    source = contents["#{scope.name}.c"]
+    exec_function = source[/^#{scope.name}_exec\(.*?^}/m]
+
+    assert_predicate(scope, :lazy_types?)
+    assert_includes(source, ".m_methods = #{scope.name}_module_methods,")
+    assert_includes(source, '{ .ml_name = "__getattr__",')
+    assert_includes(source, '{ .ml_name = "__dir__",')
+    refute_includes(exec_function, 'PyType_FromModuleAndSpec')
+    assert_includes(exec_function,
+                    "if( #{scope.name}_module_set_all( m ) < 0 ){")
+    assert_includes(source, 'PyModule_AddObject( m, "__all__", all )')
+
+    scope.classes.select(&:child?).each do |class_spec|
+      parent_ready = "ready_#{class_spec.parent_spec.snake_case_name}_type"
+      ready_name = "ready_#{class_spec.snake_case_name}_type"
+      ready_function = source[/^#{ready_name}\(.*?^}/m]
+      assert_includes(ready_function, "if( !#{parent_ready}( m, state ) ){")
+    end
+  end
+
+  def test_typemaps
+    source = generate_python_module('typemap_scope')
+
+    assert_includes(source, '#include <celsius.h>')
+    assert_includes(source, 'return PyArg_ParseTuple( args, "O&|", ' \
+                            'celsius_from_object, target );')
+    assert_includes(source, 'return celsius_to_object(return_val);')
+    assert_includes(source, 'convert_to_int8_t( PyObject *obj, ' \
+                            'void *result ) {')
+    assert_includes(source, 'value < INT8_MIN || value > INT8_MAX')
+    assert_includes(source, 'return PyLong_FromUnsignedLongLong(return_val);')
+  end
+
+  def test_typedef_constant
+    error = assert_raises(Wrapture::WrapError) do
+      generate_python_module('typedef_constant_scope')
+    end
+
+    assert_includes(error.message, 'thing_id_t')
+
+    spec = load_fixture('typedef_constant_scope')
+    spec['typemaps'] = [{ 'type' => 'thing_id_t',
+                          'to-python' => 'thing_id_to_object' }]
+    contents = {}
+    Wrapture::PythonWrapper.generate_spec_source_files(
+      Wrapture::Scope.new(spec), contents
+    )
+
+    assert_includes(contents['things.c'],
+                    'value = thing_id_to_object(THING_MAX_ID);')
+  end
+
+  def test_typedef_without_typemap
+    error = assert_raises(Wrapture::WrapError) do
+      generate_python_module('typedef_scope')
+    end
+
+    assert_includes(error.message, 'thing_id_t')
+
+    spec = load_fixture('typedef_scope')
+    spec['classes'].first['functions'].shift
+    error = assert_raises(Wrapture::WrapError) do
+      Wrapture::PythonWrapper.generate_spec_source_files(
+        Wrapture::Scope.new(spec), {}
+      )
+    end
+
+    assert_includes(error.message, 'thing_id_t')
+
+    spec['typemaps'] = [{ 'type' => 'thing_id_t',
+                          'from-python' => 'thing_id_from_object',
+                          'to-python' => 'thing_id_to_object' }]
+    contents = {}
+    Wrapture::PythonWrapper.generate_spec_source_files(
+      Wrapture::Scope.new(spec), contents
+    )
+
+    refute_includes(contents['things.c'], 'TODO')
+    assert_includes(contents['things.c'], 'thing_id_to_object(return_val)')
+  end
+
+  def test_string_return_null_check
+    source = generate_python_module('scope_without_template')
+
+    assert_includes(source, 'return return_val ? ' \
+                            'PyUnicode_FromString(return_val) : ' \
+                            '( Py_INCREF(Py_None), Py_None );')
+    refute_includes(source, 'return PyUnicode_FromString(')
+  end
+
+  def test_thread_safe_scope
+    spec = load_fixture('overloaded_functions')
+    spec['thread-safe'] = true
+    scope = Wrapture::Scope.new(spec)
+    contents = {}
+    Wrapture::PythonWrapper.generate_spec_source_files(scope, contents)
+
+    assert_predicate(scope, :thread_safe?)
+    assert_includes(contents["#{scope.name}.c"],
+                    '{ Py_mod_gil, Py_MOD_GIL_NOT_USED },')
+  end
+
+  def test_ufuncs
+    source = generate_python_module('ufunc_scope')
+
+    assert_includes(source, '#ifdef WRAPTURE_NUMPY')
+    assert_includes(source, '#include <numpy/ufuncobject.h>')
+    assert_includes(source, 'if( _import_umath() < 0 ){')
+    assert_includes(source, 'wrapture_values_2[wrapture_i] = ( double ) ' \
+                            'geometry_hypotenuse( a, b );')
+    assert_includes(source, 'double i = wrapture_values_0[wrapture_i];')
+    assert_includes(source, 'int32_t count = wrapture_values_1[wrapture_i];')
+    assert_includes(source, '( double ) geometry_scale( i, count );')
+    refute_match(/npy_intp (i|count);/, source)
+    assert_includes(source, 'geometry_is_right( angle ) ? NPY_TRUE : NPY_FALSE')
+    assert_includes(source, '{ NPY_DOUBLE, NPY_DOUBLE, NPY_DOUBLE };')
+    assert_includes(source, '"Hypotenuse_ufunc"')
+    assert_includes(source, 'Py_MOD_MULTIPLE_INTERPRETERS_NOT_SUPPORTED')
+  end
+end
@@ -20,9 +20,28 @@ require 'helper'
 
 require 'fixture'
 require 'minitest/autorun'
+require 'tmpdir'
 require 'wrapture'
 
 class ScopeTest < Minitest::Test
+  def test_build_options
+    spec = load_fixture('minimal_scope')
+
+    assert_equal({ 'include-dirs' => [], 'library-dirs' => [],
+                   'optimize' => false, 'sources' => [], 'static' => false },
+                 Wrapture::Scope.new(spec).build)
+
+    spec['build'] = { 'include-dirs' => 'include', 'optimize' => true }
+    build = Wrapture::Scope.new(spec).build
+
+    assert_equal(['include'], build['include-dirs'])
+    assert(build['optimize'])
+
+    spec['build'] = { 'link-time-optimization' => true }
+
+    assert_raises(Wrapture::InvalidSpecKey) { Wrapture::Scope.new(spec) }
+  end
+
   def test_future_scope_version
     test_spec = load_fixture('future_version_scope')
 
@@ -31,6 +50,32 @@ class ScopeTest < Minitest::Test
     end
   end
 
+  def test_json_fixtures
+    Dir.glob(fixture_file('*')).each do |yaml_file|
+      name = File.basename(yaml_file, '.yml')
+      json_file = fixture_file(name, format: 'json')
+
+      assert_equal(Wrapture::Scope.load_spec_file(yaml_file),
+                   Wrapture::Scope.load_spec_file(json_file), name)
+    end
+  end
+
+  def test_json_scope
+    yaml_scope = Wrapture::Scope.load_files(fixture_file('scope_with_enum'))
+    json_file = fixture_file('scope_with_enum', format: 'json')
+    json_scope = Wrapture::Scope.load_files(json_file)
+    yaml_contents = {}
+    json_contents = {}
+
+    [[yaml_scope, yaml_contents], [json_scope, json_contents]].each do |spec|
+      Wrapture::CppWrapper.generate_spec_source_files(*spec)
+      Wrapture::PythonWrapper.generate_spec_source_files(*spec)
+    end
+
+    refute_empty(json_contents)
+    assert_equal(yaml_contents, json_contents)
+  end
+
   def test_minimal_scope
     test_spec = load_fixture('minimal_scope')
 
@@ -45,6 +90,86 @@ class ScopeTest < Minitest::Test
     File.delete(*generated_files)
   end
 
+  def test_cmake_options
+    spec = load_fixture('scope_with_enum')
+    spec['build'] = { 'optimize' => true, 'include-dirs' => 'include' }
+    scope = Wrapture::Scope.new(spec)
+    contents = {}
+    generated = Wrapture::CppWrapper.new(scope).generate_cmake_files(contents)
+    cmake = contents['CMakeLists.txt']
+    prefix = scope.name.upcase
+
+    assert_equal(['CMakeLists.txt', "#{scope.name}Config.cmake"], generated)
+    assert_includes(cmake, "option(#{prefix}_UNITY_BUILD ")
+    assert_includes(cmake, "option(#{prefix}_IPO " \
+                           '"Build with interprocedural optimization." ON)')
+    assert_includes(cmake, "add_library(#{scope.name} " \
+                           "${#{prefix}_LIBRARY_TYPE} ${#{prefix}_SOURCES})")
+    assert_includes(cmake, "target_include_directories(#{scope.name} " \
+                           'PRIVATE include)')
+    assert_includes(cmake, "    <basic_struct.h>\n")
+    assert_includes(cmake, "install(EXPORT #{scope.name}Targets")
+
+    # the package config loads the exported targets
+    assert_includes(contents["#{scope.name}Config.cmake"],
+                    "include(${CMAKE_CURRENT_LIST_DIR}/#{scope.name}" \
+                    'Targets.cmake)')
+  end
+
+  def test_header_check
+    scope = Wrapture::Scope.new(load_fixture('minimal_scope'))
+    contents = {}
+    Wrapture::CppWrapper.new(scope).generate_cmake_files(contents)
+    cmake = contents['CMakeLists.txt']
+
+    assert_includes(cmake, "add_library(#{scope.name}_header_check OBJECT")
+    assert_includes(cmake, 'file(WRITE ${check_source} "#include <${header}>')
+  end
+
+  def test_module_cmake
+    scope = Wrapture::Scope.new(load_fixture('scope_with_enum'))
+    contents = {}
+    Wrapture::CppWrapper.new(scope).generate_cmake_files(contents,
+                                                         modules: true)
+    cmake = contents['CMakeLists.txt']
+
+    assert_includes(cmake, 'cmake_minimum_required(VERSION 3.28)')
+    assert_includes(cmake, "  #{scope.name}.cppm\n")
+    assert_includes(cmake, '  PUBLIC FILE_SET CXX_MODULES FILES ' \
+                           "${#{scope.name.upcase}_MODULES}")
+    assert_includes(cmake, "target_compile_features(#{scope.name} " \
+                           'PUBLIC cxx_std_20)')
+    refute_includes(cmake, '_header_check')
+    refute_includes(cmake, '.hpp')
+  end
+
+  def test_module_interface
+    scope = Wrapture::Scope.new(load_fixture('scope_with_enum'))
+    wrapper = Wrapture::CppWrapper.new(scope)
+    contents = {}
+    generated = wrapper.generate_source_files(contents, modules: true)
+
+    assert_equal(wrapper.source_files(modules: true), generated)
+    assert_equal(["#{scope.name}.cppm", 'BasicClass.cpp'], generated)
+
+    # the library headers stay in the global module fragment
+    interface = contents["#{scope.name}.cppm"]
+    fragment_end = interface.index("export module #{scope.name};")
+
+    refute_nil(fragment_end)
+    assert(interface.start_with?("module;\n"))
+    assert_includes(interface[0...fragment_end], '#include <basic_struct.h>')
+    assert_includes(interface, "export namespace wrapture_test {\n")
+    assert_includes(interface, "  enum class BasicEnum {\n")
+    assert_includes(interface, "  class WRAPTURE_EXPORT BasicClass final {\n")
+    refute_includes(interface, '_HPP')
+
+    unit = contents['BasicClass.cpp']
+
+    assert_includes(unit, "\nmodule #{scope.name};\n")
+    refute_includes(unit, '.hpp>')
+  end
+
   def test_nested_templates
     test_spec = load_fixture('scope_with_nested_templates')
 
@@ -84,6 +209,30 @@ class ScopeTest < Minitest::Test
     end
   end
 
+  def test_reload_files
+    Dir.mktmpdir do |dir|
+      spec = load_fixture('scope_with_template')
+      templates_file = File.join(dir, 'templates.yml')
+      File.write(templates_file, { 'templates' => spec['templates'] }.to_yaml)
+      classes_file = File.join(dir, 'classes.yml')
+      File.write(classes_file, { 'classes' => spec['classes'] }.to_yaml)
+      enum_file = File.join(dir, 'enum.yml')
+      File.write(enum_file, load_fixture('scope_with_enum').to_yaml)
+
+      scope = Wrapture::Scope.load_files(templates_file, classes_file,
+                                         enum_file)
+      class_names = scope.classes.map(&:name)
+
+      assert_equal([templates_file, classes_file, enum_file], scope.files)
+      assert_equal([enum_file], scope.reload_files(enum_file))
+      assert_equal([templates_file, classes_file],
+                   scope.reload_files(templates_file))
+      assert_equal(class_names, scope.classes.map(&:name))
+      assert_equal(scope.file_specs(classes_file).map(&:name),
+                   %w[OneClass TwoClass RedClass BlueClass])
+    end
+  end
+
   def test_scope_with_enum
     test_spec = load_fixture('scope_with_enum')
 
@@ -0,0 +1,122 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require 'helper'
+
+require 'fixture'
+require 'minitest/autorun'
+require 'objspace'
+require 'stringio'
+require 'wrapture'
+
+class SinkTest < Minitest::Test
+  def test_cpp_hash_matches_files
+    scope = Wrapture::Scope.new(load_fixture('scope_with_enum'))
+
+    contents = {}
+    generated = Wrapture::CppWrapper.generate_spec_source_files(scope, contents)
+    written = Wrapture::CppWrapper.write_spec_source_files(scope)
+
+    assert_equal(written, generated)
+    assert_equal(written.sort, contents.keys.sort)
+
+    written.each do |filename|
+      assert_equal(File.read(filename), contents[filename])
+    end
+
+    File.delete(*written)
+  end
+
+  def test_cpp_io_factory
+    scope = Wrapture::Scope.new(load_fixture('minimal_scope'))
+    streams = {}
+    factory = ->(filename) { streams[filename] = StringIO.new }
+
+    generated = Wrapture::CppWrapper.generate_spec_source_files(scope, factory)
+
+    assert_equal(generated.sort, streams.keys.sort)
+    streams.each_value { |io| assert_predicate(io, :closed?) }
+    generated.select { |f| f.end_with?('.hpp') }.each do |filename|
+      guard = filename.sub('.hpp', '_HPP').upcase
+
+      assert_includes(streams[filename].string, "#define #{guard}\n")
+    end
+  end
+
+  def test_cpp_io_stream_multiple_files
+    scope = Wrapture::Scope.new(load_fixture('minimal_scope'))
+
+    assert_raises(Wrapture::WrapError) do
+      Wrapture::CppWrapper.generate_spec_source_files(scope, StringIO.new)
+    end
+  end
+
+  def test_hash_not_preallocated
+    contents = {}
+    Wrapture::Sink.new(contents).write_file('small.txt') do |out|
+      out.call('small')
+    end
+
+    assert_equal("small\n", contents['small.txt'])
+    assert_operator(ObjectSpace.memsize_of(contents['small.txt']), :<,
+                    Wrapture::Sink::BUFFER_SIZE)
+  end
+
+  def test_invalid_factory
+    sink = Wrapture::Sink.new(->(_filename) {})
+
+    assert_raises(Wrapture::WrapError) do
+      sink.write_file('missing.txt') { |out| out.call('missing') }
+    end
+  end
+
+  def test_invalid_target
+    assert_raises(Wrapture::WrapError) do
+      Wrapture::Sink.new(42)
+    end
+  end
+
+  def test_large_file_buffering
+    io = StringIO.new
+    line = 'x' * 100
+    count = (Wrapture::Sink::BUFFER_SIZE / line.length) * 3
+
+    Wrapture::Sink.new(io).write_file('big.txt') do |out|
+      count.times { out.call(line) }
+      out.call(nil)
+      out.call("already terminated\n")
+    end
+
+    expected = "#{"#{line}\n" * count}\nalready terminated\n"
+
+    assert_equal(expected, io.string)
+  end
+
+  def test_python_hash
+    scope = Wrapture::Scope.new(load_fixture('minimal_scope'))
+    wrapper = Wrapture::PythonWrapper.new(scope)
+
+    contents = {}
+    generated = wrapper.generate_source_files(contents)
+    generated.concat(wrapper.generate_setuptools_files(contents))
+
+    assert_equal(["#{scope.name}.c", 'setup.py'], generated)
+    assert_includes(contents["#{scope.name}.c"], "PyInit_#{scope.name}")
+    assert_includes(contents['setup.py'], "Extension('#{scope.name}'")
+  end
+end
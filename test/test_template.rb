@@ -23,6 +23,49 @@ require 'minitest/autorun'
 require 'wrapture'
 
 class TemplateSpecTest < Minitest::Test
+  def test_class_template
+    scope = Wrapture::Scope.new(load_fixture('class_template_family'))
+    contents = {}
+    generated = Wrapture::CppWrapper.generate_spec_source_files(scope,
+                                                                contents)
+
+    assert_equal(['Counter.hpp', 'Counter.cpp',
+                  'LoggingCounter.hpp', 'LoggingCounter.cpp'], generated)
+
+    header = contents['Counter.hpp']
+
+    assert_includes(header, "  template<typename Traits>\n" \
+                            "  class WRAPTURE_EXPORT Counter final {\n")
+    assert_includes(header, '#include <counter.h>')
+    assert_includes(header, 'static constexpr auto increment_function = ' \
+                            'fast_increment;')
+    assert_includes(header, 'using FastCounter = Counter<FastCounterTraits>;')
+    assert_includes(header, 'extern template class Counter<SlowCounterTraits>;')
+    refute_includes(header, 'LoggingCounter')
+
+    source = contents['Counter.cpp']
+
+    assert_includes(source, "template<typename Traits>\n" \
+                            '  int Counter<Traits>::Increment( int amount ) {')
+    assert_includes(source, 'return Traits::increment_function( ')
+    assert_includes(source, 'template class Counter<FastCounterTraits>;')
+
+    # a class giving its own keys is generated on its own
+    assert_includes(contents['LoggingCounter.cpp'], 'logging_increment(')
+  end
+
+  def test_class_template_param_misuse
+    spec = load_fixture('class_template_family')
+    spec['templates'].first['value']['namespace'] = {
+      'is-param' => true, 'name' => 'new-function'
+    }
+    scope = Wrapture::Scope.new(spec)
+
+    assert_raises(Wrapture::InvalidTemplateUsage) do
+      scope.class_families
+    end
+  end
+
   def test_hash_template_usage_in_array
     scope_spec = load_fixture('hash_template_usage_in_array')
 
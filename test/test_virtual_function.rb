@@ -32,10 +32,38 @@ class FunctionSpecTest < Minitest::Test
     validate_wrapper_results(test_spec, classes)
 
     assert(file_contains_match('BaseClass.hpp', 'virtual void'))
+    assert(file_contains_match('BaseClass.hpp',
+                               'class WRAPTURE_EXPORT BaseClass final {'))
 
     File.delete(*classes)
   end
 
+  def test_extensible_class
+    test_spec = load_fixture('class_with_virtual_function')
+    test_spec['final'] = false
+
+    spec = Wrapture::ClassSpec.new(test_spec)
+
+    refute_predicate(spec, :final?)
+
+    classes = Wrapture::CppWrapper.write_spec_source_files(spec)
+    validate_wrapper_results(test_spec, classes)
+
+    assert(file_contains_match('BaseClass.hpp',
+                               'class WRAPTURE_EXPORT BaseClass {'))
+
+    File.delete(*classes)
+  end
+
+  def test_invalid_final
+    test_spec = load_fixture('class_with_virtual_function')
+    test_spec['final'] = 'yes'
+
+    assert_raises(Wrapture::InvalidSpecKey) do
+      Wrapture::ClassSpec.new(test_spec)
+    end
+  end
+
   def test_virtual_function
     test_spec = load_fixture('virtual_function')
 
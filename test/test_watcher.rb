@@ -0,0 +1,149 @@
+# SPDX-License-Identifier: Apache-2.0
+
+# frozen_string_literal: true
+
+# Copyright 2024 Joel E. Anderson
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+require 'helper'
+
+require 'fixture'
+require 'minitest/autorun'
+require 'minitest/mock'
+require 'tmpdir'
+require 'wrapture'
+
+# Writes the templates and the classes of a scope into separate spec files in
+# the given directory, along with a third file holding unrelated classes.
+def write_split_specs(dir)
+  spec = load_fixture('scope_with_template')
+  File.write(File.join(dir, 'templates.yml'),
+             { 'templates' => spec['templates'] }.to_yaml)
+  File.write(File.join(dir, 'classes.yml'),
+             { 'classes' => spec['classes'] }.to_yaml)
+  File.write(File.join(dir, 'minimal.yml'),
+             load_fixture('minimal_scope').to_yaml)
+
+  %w[templates.yml classes.yml minimal.yml].map do |filename|
+    File.join(dir, filename)
+  end
+end
+
+class WatcherTest < Minitest::Test
+  def test_invalid_update
+    Dir.mktmpdir do |dir|
+      files = write_split_specs(dir)
+      watcher = Wrapture::Watcher.new(*files, dir: dir)
+      watcher.generate
+      File.write(files[2], "classes:\n  - name: 'Unfinished'\n")
+
+      assert_raises(Wrapture::MissingNamespace) { watcher.update(files[2]) }
+      assert_equal(6, watcher.scope.classes.count)
+    end
+  end
+
+  def test_invalid_json
+    Dir.mktmpdir do |dir|
+      json_file = File.join(dir, 'minimal.json')
+      File.write(json_file, load_fixture('minimal_scope').to_json)
+      watcher = Wrapture::Watcher.new(json_file, dir: dir)
+      messages = []
+      changes = [[json_file]]
+      # the watch loop ends once there are no changes left
+      next_change = -> { changes.shift || raise(StopIteration) }
+
+      File.write(json_file, '{ "classes": [')
+      watcher.stub(:wait_for_changes, next_change) do
+        watcher.watch { |message| messages << message }
+      end
+
+      assert_equal(2, messages.length)
+      assert_match(/could not merge .*minimal\.json/, messages.last)
+      assert_equal(2, watcher.scope.classes.count)
+    end
+  end
+
+  def test_python_error
+    Dir.mktmpdir do |dir|
+      # the class is returned by value, which Python has no typemap for
+      class_spec = load_fixture('default_value_members')
+      spec_file = File.join(dir, 'scope.yml')
+      File.write(spec_file, { 'classes' => [class_spec] }.to_yaml)
+      watcher = Wrapture::Watcher.new(spec_file, dir: dir)
+      messages = []
+      changes = [[spec_file]]
+      next_change = -> { changes.shift || raise(StopIteration) }
+
+      class_spec['doc'] = 'a newly documented class'
+      File.write(spec_file, { 'classes' => [class_spec] }.to_yaml)
+      watcher.stub(:wait_for_changes, next_change) do
+        watcher.watch { |message| messages << message }
+      end
+
+      assert_equal(4, messages.length)
+      assert_match(/could not generate the Python wrapper/, messages[0])
+      assert_equal('generated 2 files', messages[1])
+      assert_match(/could not generate the Python wrapper/, messages[2])
+      assert_match(/generated 1 files in/, messages[3])
+      assert_includes(File.read(File.join(dir, 'DefaultMembersClass.hpp')),
+                      'a newly documented class')
+      assert_raises(Wrapture::WrapError) { watcher.generate }
+    end
+  end
+
+  def test_polling
+    Dir.mktmpdir do |dir|
+      files = write_split_specs(dir)
+      watcher = Wrapture::Watcher.new(*files, dir: dir)
+      File.utime(Time.now + 10, Time.now + 10, files[1])
+
+      watcher.stub(:sleep, nil) do
+        assert_equal([files[1]], watcher.send(:poll_changes))
+        assert_empty(watcher.send(:poll_changes))
+      end
+    end
+  end
+
+  def test_update
+    Dir.mktmpdir do |dir|
+      templates_file, classes_file, minimal_file = write_split_specs(dir)
+      watcher = Wrapture::Watcher.new(templates_file, classes_file,
+                                      minimal_file, dir: dir)
+
+      assert_equal(14, watcher.generate.length)
+
+      minimal_spec = load_fixture('minimal_scope')
+      minimal_spec['classes'].first['doc'] = 'a newly documented class'
+      File.write(minimal_file, minimal_spec.to_yaml)
+
+      assert_equal(['MinimalClassOne.hpp', 'wrapture_test.c'],
+                   watcher.update(minimal_file))
+      assert_includes(File.read(File.join(dir, 'MinimalClassOne.hpp')),
+                      'a newly documented class')
+
+      # the classes using a changed template are generated again as well
+      spec = load_fixture('scope_with_template')
+      spec['templates'].first['value']['functions'].first['name'] = 'ToString'
+      File.write(templates_file, { 'templates' => spec['templates'] }.to_yaml)
+      written = watcher.update(templates_file)
+
+      %w[OneClass TwoClass RedClass BlueClass].each do |class_name|
+        assert_includes(written, "#{class_name}.hpp")
+        assert_includes(File.read(File.join(dir, "#{class_name}.hpp")),
+                        'ToString')
+      end
+      refute_includes(written, 'MinimalClassOne.hpp')
+    end
+  end
+end